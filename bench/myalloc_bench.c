@@ -0,0 +1,494 @@
+// Benchmark of the allocator against the C library allocator on workloads close to real programs
+// Built with the "Benchmark" build, run as bin/bench [scale] where scale multiplies the number of operations (1 by default)
+// Every workload runs in its own process for each allocator, so that the memory used by one run does not hide the next one
+
+// Needed for mmap flags such as MAP_ANONYMOUS when compiling with -std=c11
+#define _GNU_SOURCE
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "myalloc.h"
+
+
+// Number of latencies kept per run, the percentiles are computed on them
+#define MAX_LATENCIES (1 << 22)
+
+// Number of objects alive at the same time in the batch, Larson and churn workloads
+#define BATCH_OBJECTS 1000
+#define LARSON_OBJECTS 10000
+#define CHURN_OBJECTS 50000
+#define NB_VECTORS 1000
+
+
+// Functions of an allocator, so that every workload runs the same code on both allocators
+struct Allocator_s
+{
+	const char* name;
+	void* (*allocate)(size_t size);
+	void (*release)(void* ptr);
+	void* (*reallocate)(void* ptr, size_t size);
+};
+
+typedef struct Allocator_s Allocator;
+
+
+// Results of a run, written by the process of the run and read by the main process
+struct BenchResult_s
+{
+	uint64_t nbOps;
+	uint64_t timeNs;
+	uint64_t p50Ns;
+	uint64_t p99Ns;
+	uint64_t p999Ns;
+	size_t peakRssKb;
+	size_t finalRssKb;
+};
+
+typedef struct BenchResult_s BenchResult;
+
+
+// State of a run : the allocator used, the random generator and the latencies of every call when they are measured
+struct Bench_s
+{
+	const Allocator* allocator;
+	uint64_t randomState;
+	int isTimed;
+	uint32_t* latencies;
+	uint64_t nbLatencies;
+	uint64_t nbOps;
+};
+
+typedef struct Bench_s Bench;
+
+
+// A workload and the number of times its main loop runs for a scale of 1
+struct Workload_s
+{
+	const char* name;
+	void (*run)(Bench* bench, size_t nbSteps);
+	size_t nbSteps;
+};
+
+typedef struct Workload_s Workload;
+
+
+
+
+// Returns the time in nanoseconds of a clock that never goes back
+uint64_t bench_time_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+
+// Returns the resident memory of the process in KiB
+size_t bench_rss_kb()
+{
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if(statm == NULL)
+	{
+		return 0;
+	}
+
+	size_t nbPages = 0, nbResidentPages = 0;
+	if(fscanf(statm, "%zu %zu", &nbPages, &nbResidentPages) != 2)
+	{
+		nbResidentPages = 0;
+	}
+	fclose(statm);
+
+	return nbResidentPages * (size_t)sysconf(_SC_PAGESIZE) / 1024;
+}
+
+
+// Returns a pseudo random number (xorshift64*), the same for every allocator
+uint64_t bench_random(Bench* bench)
+{
+	bench->randomState ^= bench->randomState >> 12;
+	bench->randomState ^= bench->randomState << 25;
+	bench->randomState ^= bench->randomState >> 27;
+	return bench->randomState * 0x2545F4914F6CDD1Dull;
+}
+
+
+// Returns a size following the mix of a typical program : mostly small objects, some buffers and a few large arrays
+size_t bench_random_size(Bench* bench)
+{
+	uint64_t draw = bench_random(bench);
+	uint64_t kind = draw % 100;
+	draw >>= 8;
+
+	if(kind < 80)
+		return 8 + draw % 249;
+	if(kind < 95)
+		return 256 + draw % 3841;
+	return 4096 + draw % 61441;
+}
+
+
+// Maps memory for the bookkeeping of the benchmark, so that it goes through none of the allocators measured
+void* bench_map(size_t size)
+{
+	void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ptr == MAP_FAILED)
+	{
+		printf("ERROR : no memory available for the benchmark.\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+
+
+
+// Calls to the allocator of the run, timed one by one when the latencies are measured
+
+void bench_record(Bench* bench, uint64_t startTime)
+{
+	uint64_t latency = bench_time_ns() - startTime;
+	if(bench->nbLatencies < MAX_LATENCIES)
+	{
+		bench->latencies[bench->nbLatencies++] = latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+	}
+}
+
+void* bench_malloc(Bench* bench, size_t size)
+{
+	bench->nbOps++;
+	if(!bench->isTimed)
+	{
+		return bench->allocator->allocate(size);
+	}
+
+	uint64_t startTime = bench_time_ns();
+	void* ptr = bench->allocator->allocate(size);
+	bench_record(bench, startTime);
+	return ptr;
+}
+
+void bench_free(Bench* bench, void* ptr)
+{
+	bench->nbOps++;
+	if(!bench->isTimed)
+	{
+		bench->allocator->release(ptr);
+		return;
+	}
+
+	uint64_t startTime = bench_time_ns();
+	bench->allocator->release(ptr);
+	bench_record(bench, startTime);
+}
+
+void* bench_realloc(Bench* bench, void* ptr, size_t size)
+{
+	bench->nbOps++;
+	if(!bench->isTimed)
+	{
+		return bench->allocator->reallocate(ptr, size);
+	}
+
+	uint64_t startTime = bench_time_ns();
+	void* newPtr = bench->allocator->reallocate(ptr, size);
+	bench_record(bench, startTime);
+	return newPtr;
+}
+
+
+// Writes the first and the last byte of a block, as a program would, so that its pages are really used
+void bench_touch(void* ptr, size_t size)
+{
+	((volatile char*)ptr)[0] = 1;
+	((volatile char*)ptr)[size - 1] = 1;
+}
+
+
+
+
+// Workloads
+
+// Allocates a batch of objects of random sizes then frees them in the order given by freeOrder (0 LIFO, 1 FIFO, 2 random)
+void bench_batch(Bench* bench, size_t nbSteps, int freeOrder)
+{
+	void** objects = bench_map(BATCH_OBJECTS * sizeof(void*));
+
+	for(size_t step = 0; step < nbSteps; ++step)
+	{
+		for(int i = 0; i < BATCH_OBJECTS; ++i)
+		{
+			size_t size = bench_random_size(bench);
+			objects[i] = bench_malloc(bench, size);
+			bench_touch(objects[i], size);
+		}
+
+		// Fisher-Yates shuffle for the random order
+		if(freeOrder == 2)
+		{
+			for(int i = BATCH_OBJECTS - 1; i > 0; --i)
+			{
+				int j = (int)(bench_random(bench) % (uint64_t)(i + 1));
+				void* object = objects[i];
+				objects[i] = objects[j];
+				objects[j] = object;
+			}
+		}
+
+		for(int i = 0; i < BATCH_OBJECTS; ++i)
+		{
+			bench_free(bench, objects[freeOrder == 0 ? BATCH_OBJECTS - 1 - i : i]);
+		}
+	}
+
+	munmap(objects, BATCH_OBJECTS * sizeof(void*));
+}
+
+void bench_lifo(Bench* bench, size_t nbSteps)
+{
+	bench_batch(bench, nbSteps, 0);
+}
+
+void bench_fifo(Bench* bench, size_t nbSteps)
+{
+	bench_batch(bench, nbSteps, 1);
+}
+
+void bench_random_order(Bench* bench, size_t nbSteps)
+{
+	bench_batch(bench, nbSteps, 2);
+}
+
+
+// Grows vectors element by element with a growth factor of 1.5, as dynamic arrays and string builders do, up to 64 KiB
+void bench_vectors(Bench* bench, size_t nbSteps)
+{
+	void** vectors = bench_map(NB_VECTORS * sizeof(void*));
+	size_t* capacities = bench_map(NB_VECTORS * sizeof(size_t));
+
+	for(size_t step = 0; step < nbSteps; ++step)
+	{
+		for(int i = 0; i < NB_VECTORS; ++i)
+		{
+			capacities[i] = 16;
+			vectors[i] = bench_malloc(bench, capacities[i]);
+		}
+
+		// The vectors grow in turn so that their blocks are interleaved
+		for(int round = 0; round < 24; ++round)
+		{
+			for(int i = 0; i < NB_VECTORS; ++i)
+			{
+				if(capacities[i] < 64 * 1024 && bench_random(bench) % 2 == 0)
+				{
+					capacities[i] += capacities[i] / 2;
+					vectors[i] = bench_realloc(bench, vectors[i], capacities[i]);
+					bench_touch(vectors[i], capacities[i]);
+				}
+			}
+		}
+
+		for(int i = 0; i < NB_VECTORS; ++i)
+		{
+			bench_free(bench, vectors[i]);
+		}
+	}
+
+	munmap(vectors, NB_VECTORS * sizeof(void*));
+	munmap(capacities, NB_VECTORS * sizeof(size_t));
+}
+
+
+// Larson server simulation : a pool of objects where a random object is replaced by a new one of random size at every step
+void bench_larson(Bench* bench, size_t nbSteps)
+{
+	void** objects = bench_map(LARSON_OBJECTS * sizeof(void*));
+
+	for(int i = 0; i < LARSON_OBJECTS; ++i)
+	{
+		objects[i] = bench_malloc(bench, 16 + bench_random(bench) % 497);
+	}
+
+	for(size_t step = 0; step < nbSteps; ++step)
+	{
+		size_t slot = bench_random(bench) % LARSON_OBJECTS;
+		size_t size = 16 + bench_random(bench) % 497;
+		bench_free(bench, objects[slot]);
+		objects[slot] = bench_malloc(bench, size);
+		bench_touch(objects[slot], size);
+	}
+
+	for(int i = 0; i < LARSON_OBJECTS; ++i)
+	{
+		bench_free(bench, objects[i]);
+	}
+
+	munmap(objects, LARSON_OBJECTS * sizeof(void*));
+}
+
+
+// Long running churn : objects live for a random number of steps, and the sizes go from small to large and back in phases
+// The memory left after freeing everything shows how much the allocator keeps because of fragmentation
+void bench_churn(Bench* bench, size_t nbSteps)
+{
+	void** objects = bench_map(CHURN_OBJECTS * sizeof(void*));
+	size_t* deaths = bench_map(CHURN_OBJECTS * sizeof(size_t));
+
+	for(size_t step = 0; step < nbSteps; ++step)
+	{
+		size_t slot = bench_random(bench) % CHURN_OBJECTS;
+		if(objects[slot] != NULL && deaths[slot] > step)
+		{
+			continue;
+		}
+		if(objects[slot] != NULL)
+		{
+			bench_free(bench, objects[slot]);
+		}
+
+		int phase = (int)(step / (nbSteps / 8 + 1)) % 2;
+		size_t size = phase == 0 ? 16 + bench_random(bench) % 241 : 1024 + bench_random(bench) % 15361;
+		objects[slot] = bench_malloc(bench, size);
+		bench_touch(objects[slot], size);
+		deaths[slot] = step + bench_random(bench) % (4 * CHURN_OBJECTS);
+	}
+
+	for(int i = 0; i < CHURN_OBJECTS; ++i)
+	{
+		if(objects[i] != NULL)
+		{
+			bench_free(bench, objects[i]);
+		}
+	}
+
+	munmap(objects, CHURN_OBJECTS * sizeof(void*));
+	munmap(deaths, CHURN_OBJECTS * sizeof(size_t));
+}
+
+
+
+
+// Running the workloads
+
+int bench_compare_latencies(const void* a, const void* b)
+{
+	uint32_t latencyA = *(const uint32_t*)a;
+	uint32_t latencyB = *(const uint32_t*)b;
+	return (latencyA > latencyB) - (latencyA < latencyB);
+}
+
+
+// Runs a workload once for the throughput, then again timing every call for the percentiles
+// Called in the process of the run, the peak is the largest resident memory of the process
+void bench_run(const Workload* workload, const Allocator* allocator, size_t scale, BenchResult* result)
+{
+	Bench bench;
+	bench.allocator = allocator;
+	bench.randomState = 0x9E3779B97F4A7C15ull;
+	bench.isTimed = 0;
+	bench.latencies = bench_map(MAX_LATENCIES * sizeof(uint32_t));
+	bench.nbLatencies = 0;
+	bench.nbOps = 0;
+
+	uint64_t startTime = bench_time_ns();
+	workload->run(&bench, workload->nbSteps * scale);
+	result->timeNs = bench_time_ns() - startTime;
+	result->nbOps = bench.nbOps;
+	result->finalRssKb = bench_rss_kb();
+
+	bench.randomState = 0x9E3779B97F4A7C15ull;
+	bench.isTimed = 1;
+	workload->run(&bench, workload->nbSteps * scale);
+
+	qsort(bench.latencies, bench.nbLatencies, sizeof(uint32_t), bench_compare_latencies);
+	result->p50Ns = bench.nbLatencies ? bench.latencies[bench.nbLatencies / 2] : 0;
+	result->p99Ns = bench.nbLatencies ? bench.latencies[bench.nbLatencies * 99 / 100] : 0;
+	result->p999Ns = bench.nbLatencies ? bench.latencies[bench.nbLatencies * 999 / 1000] : 0;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	result->peakRssKb = (size_t)usage.ru_maxrss;
+
+	munmap(bench.latencies, MAX_LATENCIES * sizeof(uint32_t));
+}
+
+
+// Runs a workload in a new process and prints its results, returns 0 if the process failed
+int bench_run_process(const Workload* workload, const Allocator* allocator, size_t scale)
+{
+	int fds[2];
+	if(pipe(fds) != 0)
+	{
+		return 0;
+	}
+
+	fflush(stdout);
+	pid_t pid = fork();
+	if(pid == 0)
+	{
+		BenchResult result;
+		bench_run(workload, allocator, scale, &result);
+		ssize_t written = write(fds[1], &result, sizeof(result));
+		_exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+	}
+	close(fds[1]);
+
+	BenchResult result;
+	ssize_t nbRead = pid > 0 ? read(fds[0], &result, sizeof(result)) : 0;
+	close(fds[0]);
+	if(pid > 0)
+	{
+		waitpid(pid, NULL, 0);
+	}
+	if(nbRead != (ssize_t)sizeof(result))
+	{
+		printf("%-14s %-10s failed\n", workload->name, allocator->name);
+		return 0;
+	}
+
+	printf("%-14s %-10s %12.0f %9d %9d %9d %12d %12d\n", workload->name, allocator->name,
+		(double)result.nbOps * 1e9 / (double)result.timeNs,
+		(int)result.p50Ns, (int)result.p99Ns, (int)result.p999Ns,
+		(int)result.peakRssKb, (int)result.finalRssKb);
+	return 1;
+}
+
+
+
+
+int main(int argc, char** argv)
+{
+	size_t scale = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 1;
+	if(scale == 0)
+		scale = 1;
+
+	const Allocator allocators[] =
+	{
+		{"myalloc", myMalloc, myFree, myRealloc},
+		{"libc", malloc, free, realloc}
+	};
+
+	const Workload workloads[] =
+	{
+		{"lifo", bench_lifo, 200},
+		{"fifo", bench_fifo, 200},
+		{"random-free", bench_random_order, 200},
+		{"vectors", bench_vectors, 5},
+		{"larson", bench_larson, 1000000},
+		{"churn", bench_churn, 1000000}
+	};
+
+	printf("%-14s %-10s %12s %9s %9s %9s %12s %12s\n", "workload", "allocator", "ops/s", "p50 ns", "p99 ns", "p999 ns", "peak RSS KiB", "final RSS KiB");
+
+	int hasFailed = 0;
+	for(size_t i = 0; i < sizeof(workloads) / sizeof(Workload); ++i)
+	{
+		for(size_t j = 0; j < sizeof(allocators) / sizeof(Allocator); ++j)
+		{
+			hasFailed |= !bench_run_process(&workloads[i], &allocators[j], scale);
+		}
+	}
+
+	return hasFailed;
+}
@@ -0,0 +1,451 @@
+// Benchmark of the allocator against the C library allocator with 1 to N threads
+// Built with the "Thread benchmark" build, run as bin/bench_threads [maxThreads] [scale] (the number of CPUs and 1 by default)
+// Every run happens in its own process, so that the state left by one run does not change the next one
+// For each number of threads it prints the throughput, the scaling over one thread and a bar which is full for a linear scaling
+// The context switches count the threads waiting on a contended lock, and the yields of the producer/consumer pattern
+
+// Needed for mmap flags such as MAP_ANONYMOUS and for pthread barriers when compiling with -std=c11
+#define _GNU_SOURCE
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "myalloc.h"
+
+
+// Number of allocations made by each thread for a scale of 1
+#define THREAD_OPS 1000000
+
+// Number of objects a thread keeps before freeing them in the local pattern
+#define LOCAL_BATCH 100
+// Number of objects in flight between two threads in the producer/consumer pattern
+#define RING_SIZE 1024
+// Number of slots shared by every thread in the handoff pattern
+#define HANDOFF_SLOTS 4096
+
+// Number of counters of each thread and number of increments of each counter in the false sharing test
+#define SHARING_COUNTERS 64
+#define SHARING_ROUNDS 100000
+
+
+// Functions of an allocator, so that every pattern runs the same code on both allocators
+struct Allocator_s
+{
+	const char* name;
+	void* (*allocate)(size_t size);
+	void (*release)(void* ptr);
+	void* (*allocateAligned)(size_t alignment, size_t size);
+};
+
+typedef struct Allocator_s Allocator;
+
+
+// Objects sent by one thread to the next one, the indices are on their own cache lines
+struct Ring_s
+{
+	_Alignas(64) _Atomic size_t head;
+	_Alignas(64) _Atomic size_t tail;
+	_Alignas(64) void* objects[RING_SIZE];
+};
+
+typedef struct Ring_s Ring;
+
+
+// State shared by the threads of a run
+struct Run_s
+{
+	const Allocator* allocator;
+	int nbThreads;
+	size_t nbOps;
+	pthread_barrier_t barrier;
+	Ring* rings;
+	void* _Atomic* slots;
+	// Time of each thread in the false sharing test, with 16-byte counters and then with counters on their own cache line
+	uint64_t* sharingTimes;
+	uint64_t* paddedTimes;
+};
+
+typedef struct Run_s Run;
+
+
+// Argument of a thread
+struct Worker_s
+{
+	Run* run;
+	const struct Pattern_s* pattern;
+	int id;
+};
+
+typedef struct Worker_s Worker;
+
+
+// Results of a run, written by the process of the run and read by the main process
+struct RunResult_s
+{
+	uint64_t timeNs;
+	long nbContextSwitches;
+	double sharingCost;
+};
+
+typedef struct RunResult_s RunResult;
+
+
+// A pattern of allocations, run by every thread
+struct Pattern_s
+{
+	const char* name;
+	void (*work)(Run* run, int id);
+};
+
+typedef struct Pattern_s Pattern;
+
+
+
+
+// Returns the time in nanoseconds of a clock that never goes back
+uint64_t bench_time_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+
+// Returns a pseudo random number (xorshift64*)
+uint64_t bench_random(uint64_t* state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1Dull;
+}
+
+
+// Maps memory for the bookkeeping of the benchmark, so that it goes through none of the allocators measured
+void* bench_map(size_t size)
+{
+	void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ptr == MAP_FAILED)
+	{
+		printf("ERROR : no memory available for the benchmark.\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+
+
+
+// Patterns
+
+// Every thread allocates and frees its own objects
+void pattern_local(Run* run, int id)
+{
+	void* objects[LOCAL_BATCH];
+	uint64_t randomState = 0x9E3779B97F4A7C15ull + (uint64_t)id;
+
+	for(size_t op = 0; op < run->nbOps; op += LOCAL_BATCH)
+	{
+		for(int i = 0; i < LOCAL_BATCH; ++i)
+		{
+			objects[i] = run->allocator->allocate(16 + bench_random(&randomState) % 497);
+			*(char*)objects[i] = 1;
+		}
+		for(int i = LOCAL_BATCH - 1; i >= 0; --i)
+		{
+			run->allocator->release(objects[i]);
+		}
+	}
+}
+
+
+// Every thread sends the objects it allocates to the next thread, which frees them
+void pattern_producer_consumer(Run* run, int id)
+{
+	Ring* outRing = &run->rings[(id + 1) % run->nbThreads];
+	Ring* inRing = &run->rings[id];
+	uint64_t randomState = 0x9E3779B97F4A7C15ull + (uint64_t)id;
+	size_t nbProduced = 0, nbConsumed = 0;
+
+	// The previous thread sends exactly as many objects as this one
+	while(nbProduced < run->nbOps || nbConsumed < run->nbOps)
+	{
+		int hasProgressed = 0;
+
+		size_t tail = atomic_load_explicit(&outRing->tail, memory_order_relaxed);
+		if(nbProduced < run->nbOps && tail - atomic_load_explicit(&outRing->head, memory_order_acquire) < RING_SIZE)
+		{
+			void* object = run->allocator->allocate(16 + bench_random(&randomState) % 497);
+			*(char*)object = 1;
+			outRing->objects[tail % RING_SIZE] = object;
+			atomic_store_explicit(&outRing->tail, tail + 1, memory_order_release);
+			nbProduced++;
+			hasProgressed = 1;
+		}
+
+		size_t head = atomic_load_explicit(&inRing->head, memory_order_relaxed);
+		if(head != atomic_load_explicit(&inRing->tail, memory_order_acquire))
+		{
+			run->allocator->release(inRing->objects[head % RING_SIZE]);
+			atomic_store_explicit(&inRing->head, head + 1, memory_order_release);
+			nbConsumed++;
+			hasProgressed = 1;
+		}
+
+		// Lets the other threads run when there are more threads than processors
+		if(!hasProgressed)
+			sched_yield();
+	}
+}
+
+
+// Every thread puts its objects in slots shared by every thread and frees the object it takes out, allocated by any thread
+void pattern_handoff(Run* run, int id)
+{
+	uint64_t randomState = 0x9E3779B97F4A7C15ull + (uint64_t)id;
+
+	for(size_t op = 0; op < run->nbOps; ++op)
+	{
+		void* object = run->allocator->allocate(16 + bench_random(&randomState) % 497);
+		*(char*)object = 1;
+		void* oldObject = atomic_exchange(&run->slots[bench_random(&randomState) % HANDOFF_SLOTS], object);
+		if(oldObject != NULL)
+		{
+			run->allocator->release(oldObject);
+		}
+	}
+}
+
+
+// Increments counters allocated by each thread at the same time, first of 16 bytes and then alone on their cache line
+// When the allocator gives neighbour blocks to different threads, they write on the same cache lines
+void pattern_false_sharing(Run* run, int id)
+{
+	volatile long* counters[SHARING_COUNTERS];
+
+	for(int padded = 0; padded < 2; ++padded)
+	{
+		for(int i = 0; i < SHARING_COUNTERS; ++i)
+		{
+			counters[i] = padded ? run->allocator->allocateAligned(64, 64) : run->allocator->allocate(16);
+			*counters[i] = 0;
+		}
+		pthread_barrier_wait(&run->barrier);
+
+		uint64_t startTime = bench_time_ns();
+		for(int round = 0; round < SHARING_ROUNDS; ++round)
+		{
+			for(int i = 0; i < SHARING_COUNTERS; ++i)
+			{
+				(*counters[i])++;
+			}
+		}
+		(padded ? run->paddedTimes : run->sharingTimes)[id] = bench_time_ns() - startTime;
+		pthread_barrier_wait(&run->barrier);
+
+		for(int i = 0; i < SHARING_COUNTERS; ++i)
+		{
+			run->allocator->release((void*)counters[i]);
+		}
+	}
+}
+
+
+
+
+// Running the patterns
+
+// Waits for every thread to be created, then runs the pattern
+void* bench_worker(void* arg)
+{
+	Worker* worker = arg;
+	pthread_barrier_wait(&worker->run->barrier);
+	worker->pattern->work(worker->run, worker->id);
+	return NULL;
+}
+
+
+// Runs a pattern with nbThreads threads, in the process of the run
+void bench_run(const Pattern* pattern, const Allocator* allocator, int nbThreads, size_t scale, RunResult* result)
+{
+	Run run;
+	run.allocator = allocator;
+	run.nbThreads = nbThreads;
+	run.nbOps = THREAD_OPS * scale;
+	pthread_barrier_init(&run.barrier, NULL, (unsigned int)nbThreads + 1);
+	run.rings = bench_map((size_t)nbThreads * sizeof(Ring));
+	run.slots = bench_map(HANDOFF_SLOTS * sizeof(void*));
+	run.sharingTimes = bench_map((size_t)nbThreads * sizeof(uint64_t));
+	run.paddedTimes = bench_map((size_t)nbThreads * sizeof(uint64_t));
+
+	pthread_t* threads = bench_map((size_t)nbThreads * sizeof(pthread_t));
+	Worker* workers = bench_map((size_t)nbThreads * sizeof(Worker));
+	for(int i = 0; i < nbThreads; ++i)
+	{
+		workers[i].run = &run;
+		workers[i].pattern = pattern;
+		workers[i].id = i;
+		pthread_create(&threads[i], NULL, bench_worker, &workers[i]);
+	}
+
+	struct rusage usageBefore, usageAfter;
+	getrusage(RUSAGE_SELF, &usageBefore);
+
+	// The false sharing pattern waits on the barrier twice for each kind of counters, with the main thread
+	pthread_barrier_wait(&run.barrier);
+	uint64_t startTime = bench_time_ns();
+	if(pattern->work == pattern_false_sharing)
+	{
+		for(int i = 0; i < 4; ++i)
+		{
+			pthread_barrier_wait(&run.barrier);
+		}
+	}
+	for(int i = 0; i < nbThreads; ++i)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	result->timeNs = bench_time_ns() - startTime;
+
+	getrusage(RUSAGE_SELF, &usageAfter);
+	result->nbContextSwitches = (usageAfter.ru_nvcsw - usageBefore.ru_nvcsw) + (usageAfter.ru_nivcsw - usageBefore.ru_nivcsw);
+
+	uint64_t sharingTime = 0, paddedTime = 0;
+	for(int i = 0; i < nbThreads; ++i)
+	{
+		sharingTime += run.sharingTimes[i];
+		paddedTime += run.paddedTimes[i];
+	}
+	result->sharingCost = paddedTime ? (double)sharingTime / (double)paddedTime : 0;
+}
+
+
+// Runs a pattern in a new process, returns 0 if the process failed
+int bench_run_process(const Pattern* pattern, const Allocator* allocator, int nbThreads, size_t scale, RunResult* result)
+{
+	int fds[2];
+	if(pipe(fds) != 0)
+	{
+		return 0;
+	}
+
+	fflush(stdout);
+	pid_t pid = fork();
+	if(pid == 0)
+	{
+		bench_run(pattern, allocator, nbThreads, scale, result);
+		ssize_t written = write(fds[1], result, sizeof(RunResult));
+		_exit(written == (ssize_t)sizeof(RunResult) ? 0 : 1);
+	}
+	close(fds[1]);
+
+	ssize_t nbRead = pid > 0 ? read(fds[0], result, sizeof(RunResult)) : 0;
+	close(fds[0]);
+	if(pid > 0)
+	{
+		waitpid(pid, NULL, 0);
+	}
+	return nbRead == (ssize_t)sizeof(RunResult);
+}
+
+
+// Prints a bar of length proportional to value, maxValue giving a bar of width characters
+void bench_print_bar(double value, double maxValue, int width)
+{
+	int length = maxValue > 0 ? (int)(value / maxValue * width + 0.5) : 0;
+	for(int i = 0; i < length; ++i)
+	{
+		printf("#");
+	}
+}
+
+
+
+
+int main(int argc, char** argv)
+{
+	int maxThreads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	size_t scale = argc > 2 ? (size_t)strtoul(argv[2], NULL, 10) : 1;
+	if(maxThreads < 1)
+		maxThreads = 1;
+	if(scale == 0)
+		scale = 1;
+
+	const Allocator allocators[] =
+	{
+		{"myalloc", myMalloc, myFree, myAlignedAlloc},
+		{"libc", malloc, free, aligned_alloc}
+	};
+
+	const Pattern patterns[] =
+	{
+		{"local", pattern_local},
+		{"producer-consumer", pattern_producer_consumer},
+		{"handoff", pattern_handoff}
+	};
+
+	// Powers of two up to maxThreads, and maxThreads itself
+	int threadCounts[32];
+	int nbThreadCounts = 0;
+	for(int nbThreads = 1; nbThreads < maxThreads && nbThreadCounts < 31; nbThreads *= 2)
+	{
+		threadCounts[nbThreadCounts++] = nbThreads;
+	}
+	threadCounts[nbThreadCounts++] = maxThreads;
+
+	int hasFailed = 0;
+	for(size_t i = 0; i < sizeof(patterns) / sizeof(Pattern); ++i)
+	{
+		printf("\nPattern %s (%d allocations per thread)\n", patterns[i].name, (int)(THREAD_OPS * scale));
+		printf("%-10s %8s %12s %8s %14s\n", "allocator", "threads", "Mops/s", "scaling", "switches/Mop");
+
+		for(size_t j = 0; j < sizeof(allocators) / sizeof(Allocator); ++j)
+		{
+			double singleThroughput = 0;
+			double throughputs[32];
+			for(int k = 0; k < nbThreadCounts; ++k)
+			{
+				RunResult result;
+				if(!bench_run_process(&patterns[i], &allocators[j], threadCounts[k], scale, &result))
+				{
+					printf("%-10s %8d failed\n", allocators[j].name, threadCounts[k]);
+					hasFailed = 1;
+					throughputs[k] = 0;
+					continue;
+				}
+
+				// Every thread allocates and frees nbOps objects
+				double nbMops = 2.0 * (double)THREAD_OPS * (double)scale * threadCounts[k] / 1e6;
+				throughputs[k] = nbMops / ((double)result.timeNs / 1e9);
+				if(k == 0)
+					singleThroughput = throughputs[k];
+
+				printf("%-10s %8d %12.2f %7.2fx %14.1f  ", allocators[j].name, threadCounts[k], throughputs[k],
+					singleThroughput > 0 ? throughputs[k] / singleThroughput : 0, (double)result.nbContextSwitches / nbMops);
+				bench_print_bar(throughputs[k], throughputs[0] * threadCounts[k], 20);
+				printf("\n");
+			}
+		}
+	}
+
+	// The cost of false sharing is the time of the increments on 16-byte counters over the time on padded counters
+	Pattern sharingPattern = {"false-sharing", pattern_false_sharing};
+	printf("\nFalse sharing (time with 16-byte counters / time with counters alone on their cache line)\n");
+	printf("%-10s %8s %12s\n", "allocator", "threads", "cost");
+	for(size_t j = 0; j < sizeof(allocators) / sizeof(Allocator); ++j)
+	{
+		for(int k = 0; k < nbThreadCounts; ++k)
+		{
+			RunResult result;
+			if(!bench_run_process(&sharingPattern, &allocators[j], threadCounts[k], scale, &result))
+			{
+				printf("%-10s %8d failed\n", allocators[j].name, threadCounts[k]);
+				hasFailed = 1;
+				continue;
+			}
+			printf("%-10s %8d %11.2fx\n", allocators[j].name, threadCounts[k], result.sharingCost);
+		}
+	}
+
+	return hasFailed;
+}
@@ -0,0 +1,474 @@
+// Replays a trace recorded with myTraceStart (or MYALLOC_TRACE with the preload library) against the allocator and the C library allocator
+// Built with the "Replay" build, run as bin/replay trace [myalloc|libc] (both by default)
+// The calls of every thread are replayed by one thread in the order of their times, so that every run does exactly the same calls
+// Each allocator replays the trace in its own process, and reports the time of the calls and the peak of the memory it used
+
+// Needed for mmap flags such as MAP_ANONYMOUS when compiling with -std=c11
+#define _GNU_SOURCE
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "myalloc.h"
+
+
+// The resident memory is read every RSS_PERIOD calls
+#define RSS_PERIOD 4096
+
+
+// Functions of an allocator, so that the replay runs the same code on both allocators
+struct Allocator_s
+{
+	const char* name;
+	void* (*allocate)(size_t size);
+	void* (*allocateAligned)(size_t alignment, size_t size);
+	void* (*allocateZeroed)(size_t nbElements, size_t size);
+	void (*release)(void* ptr);
+	void* (*reallocate)(void* ptr, size_t size);
+};
+
+typedef struct Allocator_s Allocator;
+
+
+// A call of the trace, where the blocks are numbered in the order of their allocation instead of their addresses
+struct ReplayOp_s
+{
+	uint64_t operation;
+	uint64_t size;
+	// Alignment of TRACE_ALIGNED_ALLOC
+	uint64_t argument;
+	// Block allocated or freed, and block given to TRACE_REALLOC
+	uint32_t id;
+	uint32_t oldId;
+};
+
+typedef struct ReplayOp_s ReplayOp;
+
+
+// The calls of a trace ready to be replayed
+struct Replay_s
+{
+	ReplayOp* ops;
+	size_t nbOps;
+	uint32_t nbIds;
+	size_t nbRecords;
+	// Frees of blocks allocated before the trace started, which are not replayed
+	size_t nbUnmatched;
+	// Allocations of an address still in use, whose free was recorded with a later time by another thread
+	size_t nbReordered;
+	size_t peakLiveBytes;
+};
+
+typedef struct Replay_s Replay;
+
+
+// Open addressing table from the addresses of the traced blocks in use to their numbers
+struct AddressMap_s
+{
+	uint64_t* addresses;
+	uint32_t* ids;
+	size_t mask;
+};
+
+typedef struct AddressMap_s AddressMap;
+
+
+// Results of a replay, written by the process of the replay and read by the main process
+struct ReplayResult_s
+{
+	uint64_t timeNs;
+	size_t baseRssKb;
+	size_t peakRssKb;
+};
+
+typedef struct ReplayResult_s ReplayResult;
+
+
+
+
+// Returns the time in nanoseconds of a clock that never goes back
+uint64_t replay_time_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+
+// Returns the resident memory of the process in KiB, read without allocating any memory
+size_t replay_rss_kb()
+{
+	int fd = open("/proc/self/statm", O_RDONLY);
+	if(fd < 0)
+		return 0;
+
+	char content[128];
+	ssize_t size = read(fd, content, sizeof(content) - 1);
+	close(fd);
+	if(size <= 0)
+		return 0;
+	content[size] = '\0';
+
+	char* residentPages = NULL;
+	strtoul(content, &residentPages, 10);
+	return strtoul(residentPages, NULL, 10) * ((size_t)sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+// Maps memory for the bookkeeping of the replay, so that it goes through none of the allocators measured
+void* replay_map(size_t size)
+{
+	void* ptr = mmap(NULL, size > 0 ? size : 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ptr == MAP_FAILED)
+	{
+		printf("ERROR : no memory available for the replay.\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+
+
+
+// Table of addresses
+
+// Returns the slot of an address, or the empty slot where it would be inserted
+size_t address_slot(AddressMap* map, uint64_t address)
+{
+	size_t slot = (size_t)((address >> 4) * 0x9E3779B97F4A7C15ull) & map->mask;
+	while(map->addresses[slot] != 0 && map->addresses[slot] != address)
+	{
+		slot = (slot + 1) & map->mask;
+	}
+	return slot;
+}
+
+
+// Removes the address of a slot, moving back the addresses that follow it so that no search stops at the empty slot
+void remove_address(AddressMap* map, size_t slot)
+{
+	size_t hole = slot;
+	map->addresses[hole] = 0;
+	for(size_t next = (hole + 1) & map->mask; map->addresses[next] != 0; next = (next + 1) & map->mask)
+	{
+		size_t home = (size_t)((map->addresses[next] >> 4) * 0x9E3779B97F4A7C15ull) & map->mask;
+		// The address can fill the hole if its home slot is not between the hole and its slot
+		if(((next - home) & map->mask) >= ((next - hole) & map->mask))
+		{
+			map->addresses[hole] = map->addresses[next];
+			map->ids[hole] = map->ids[next];
+			map->addresses[next] = 0;
+			hole = next;
+		}
+	}
+}
+
+
+
+
+// Loading a trace
+
+// Orders the records by time, a free before an allocation of the same time since it may give back the same address
+int compare_records(const void* a, const void* b)
+{
+	const TraceRecord* recordA = a;
+	const TraceRecord* recordB = b;
+	if(recordA->time != recordB->time)
+		return recordA->time < recordB->time ? -1 : 1;
+	int isFreeA = (recordA->sizeOperation & ((1 << TRACE_OPERATION_BITS) - 1)) == TRACE_FREE;
+	int isFreeB = (recordB->sizeOperation & ((1 << TRACE_OPERATION_BITS) - 1)) == TRACE_FREE;
+	return isFreeB - isFreeA;
+}
+
+
+// Adds a call to the replay
+void add_op(Replay* replay, uint64_t operation, uint64_t size, uint64_t argument, uint32_t id, uint32_t oldId)
+{
+	ReplayOp* op = &replay->ops[replay->nbOps++];
+	op->operation = operation;
+	op->size = size;
+	op->argument = argument;
+	op->id = id;
+	op->oldId = oldId;
+}
+
+
+// Numbers a new block at address, freeing first the block still recorded at the same address
+uint32_t add_block(Replay* replay, AddressMap* map, uint64_t* sizes, size_t* liveBytes, uint64_t address, uint64_t size)
+{
+	size_t slot = address_slot(map, address);
+	if(map->addresses[slot] != 0)
+	{
+		uint32_t oldId = map->ids[slot];
+		add_op(replay, TRACE_FREE, 0, 0, oldId, 0);
+		*liveBytes -= sizes[oldId];
+		remove_address(map, slot);
+		slot = address_slot(map, address);
+		replay->nbReordered++;
+	}
+
+	uint32_t id = replay->nbIds++;
+	map->addresses[slot] = address;
+	map->ids[slot] = id;
+	sizes[id] = size;
+	*liveBytes += size;
+	if(*liveBytes > replay->peakLiveBytes)
+		replay->peakLiveBytes = *liveBytes;
+	return id;
+}
+
+
+// Finds the number of the block at address and forgets its address, returns 0 if no block is recorded there
+int remove_block(AddressMap* map, uint64_t* sizes, size_t* liveBytes, uint64_t address, uint32_t* id)
+{
+	size_t slot = address_slot(map, address);
+	if(map->addresses[slot] == 0)
+		return 0;
+
+	*id = map->ids[slot];
+	*liveBytes -= sizes[*id];
+	remove_address(map, slot);
+	return 1;
+}
+
+
+// Reads a trace file and turns its records into the calls of a replay, returns 0 if the file is not a trace
+int load_trace(const char* path, Replay* replay)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat fileStat;
+	if(fd < 0 || fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(TraceHeader))
+	{
+		printf("ERROR : the trace %s cannot be read.\n", path);
+		return 0;
+	}
+
+	char* content = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	TraceHeader* header = (TraceHeader*)content;
+	if(content == MAP_FAILED || memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 || header->version != TRACE_VERSION || header->recordSize != sizeof(TraceRecord))
+	{
+		printf("ERROR : %s is not a trace of this version of the allocator.\n", path);
+		return 0;
+	}
+
+	// The records of different threads are mixed in the file, they are sorted by time
+	size_t nbRecords = ((size_t)fileStat.st_size - sizeof(TraceHeader)) / sizeof(TraceRecord);
+	TraceRecord* records = replay_map(nbRecords * sizeof(TraceRecord));
+	memcpy(records, content + sizeof(TraceHeader), nbRecords * sizeof(TraceRecord));
+	munmap(content, (size_t)fileStat.st_size);
+	qsort(records, nbRecords, sizeof(TraceRecord), compare_records);
+
+	// A record gives at most two calls : the free of a reordered block and the call itself
+	memset(replay, 0, sizeof(Replay));
+	replay->nbRecords = nbRecords;
+	replay->ops = replay_map(2 * nbRecords * sizeof(ReplayOp));
+	uint64_t* sizes = replay_map(nbRecords * sizeof(uint64_t));
+
+	AddressMap map;
+	size_t capacity = 16;
+	while(capacity < 2 * nbRecords)
+	{
+		capacity *= 2;
+	}
+	map.addresses = replay_map(capacity * sizeof(uint64_t));
+	map.ids = replay_map(capacity * sizeof(uint32_t));
+	map.mask = capacity - 1;
+
+	size_t liveBytes = 0;
+	for(size_t i = 0; i < nbRecords; ++i)
+	{
+		uint64_t operation = records[i].sizeOperation & ((1 << TRACE_OPERATION_BITS) - 1);
+		uint64_t size = records[i].sizeOperation >> TRACE_OPERATION_BITS;
+		uint64_t ptr = records[i].ptr;
+		uint32_t id, oldId;
+
+		if(operation == TRACE_REALLOC && records[i].argument == 0)
+			operation = TRACE_MALLOC;
+
+		if(operation == TRACE_FREE)
+		{
+			if(ptr == 0)
+				continue;
+			if(remove_block(&map, sizes, &liveBytes, ptr, &id))
+				add_op(replay, TRACE_FREE, 0, 0, id, 0);
+			else
+				replay->nbUnmatched++;
+		}
+		else if(operation == TRACE_REALLOC)
+		{
+			// A failed realloc leaves the block unchanged
+			if(ptr == 0)
+				continue;
+			if(!remove_block(&map, sizes, &liveBytes, records[i].argument, &oldId))
+			{
+				replay->nbUnmatched++;
+				add_op(replay, TRACE_MALLOC, size, 0, add_block(replay, &map, sizes, &liveBytes, ptr, size), 0);
+				continue;
+			}
+			id = add_block(replay, &map, sizes, &liveBytes, ptr, size);
+			add_op(replay, TRACE_REALLOC, size, 0, id, oldId);
+		}
+		else if(operation == TRACE_MALLOC || operation == TRACE_ALIGNED_ALLOC || operation == TRACE_CALLOC)
+		{
+			if(ptr == 0)
+				continue;
+			id = add_block(replay, &map, sizes, &liveBytes, ptr, size);
+			add_op(replay, operation, size, records[i].argument, id, 0);
+		}
+	}
+
+	munmap(records, nbRecords * sizeof(TraceRecord));
+	munmap(sizes, nbRecords * sizeof(uint64_t));
+	munmap(map.addresses, capacity * sizeof(uint64_t));
+	munmap(map.ids, capacity * sizeof(uint32_t));
+	return 1;
+}
+
+
+
+
+// Replaying a trace
+
+// Replays every call of the trace with an allocator, in the process of the replay
+void replay_run(Replay* replay, const Allocator* allocator, ReplayResult* result)
+{
+	void** blocks = replay_map((size_t)replay->nbIds * sizeof(void*));
+	result->baseRssKb = replay_rss_kb();
+	result->peakRssKb = result->baseRssKb;
+
+	// The time spent reading the resident memory is not counted
+	uint64_t rssTime = 0;
+	uint64_t startTime = replay_time_ns();
+	for(size_t i = 0; i < replay->nbOps; ++i)
+	{
+		ReplayOp* op = &replay->ops[i];
+		switch(op->operation)
+		{
+			case TRACE_MALLOC:
+				blocks[op->id] = allocator->allocate(op->size);
+				break;
+			case TRACE_ALIGNED_ALLOC:
+				blocks[op->id] = allocator->allocateAligned(op->argument, op->size);
+				break;
+			case TRACE_CALLOC:
+				blocks[op->id] = allocator->allocateZeroed(1, op->size);
+				break;
+			case TRACE_REALLOC:
+				blocks[op->id] = allocator->reallocate(blocks[op->oldId], op->size);
+				if(blocks[op->id] != NULL)
+					blocks[op->oldId] = NULL;
+				break;
+			default:
+				allocator->release(blocks[op->id]);
+				blocks[op->id] = NULL;
+				break;
+		}
+
+		// The program that was traced wrote in its blocks
+		if(op->operation != TRACE_FREE && blocks[op->id] != NULL && op->size > 0)
+			*(char*)blocks[op->id] = 1;
+
+		if(i % RSS_PERIOD == 0)
+		{
+			uint64_t rssStartTime = replay_time_ns();
+			size_t rssKb = replay_rss_kb();
+			if(rssKb > result->peakRssKb)
+				result->peakRssKb = rssKb;
+			rssTime += replay_time_ns() - rssStartTime;
+		}
+	}
+	result->timeNs = replay_time_ns() - startTime - rssTime;
+
+	size_t rssKb = replay_rss_kb();
+	if(rssKb > result->peakRssKb)
+		result->peakRssKb = rssKb;
+
+	// The blocks still in use at the end of the trace are freed after the time is measured
+	for(uint32_t id = 0; id < replay->nbIds; ++id)
+	{
+		if(blocks[id] != NULL)
+			allocator->release(blocks[id]);
+	}
+}
+
+
+// Replays the trace in a new process, returns 0 if the process failed
+int replay_run_process(Replay* replay, const Allocator* allocator, ReplayResult* result)
+{
+	int fds[2];
+	if(pipe(fds) != 0)
+	{
+		return 0;
+	}
+
+	fflush(stdout);
+	pid_t pid = fork();
+	if(pid == 0)
+	{
+		replay_run(replay, allocator, result);
+		ssize_t written = write(fds[1], result, sizeof(ReplayResult));
+		_exit(written == (ssize_t)sizeof(ReplayResult) ? 0 : 1);
+	}
+	close(fds[1]);
+
+	ssize_t nbRead = pid > 0 ? read(fds[0], result, sizeof(ReplayResult)) : 0;
+	close(fds[0]);
+	if(pid > 0)
+	{
+		waitpid(pid, NULL, 0);
+	}
+	return nbRead == (ssize_t)sizeof(ReplayResult);
+}
+
+
+
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		printf("Usage : %s trace [myalloc|libc]\n", argv[0]);
+		return 1;
+	}
+
+	const Allocator allocators[] =
+	{
+		{"myalloc", myMalloc, myAlignedAlloc, myCalloc, myFree, myRealloc},
+		{"libc", malloc, aligned_alloc, calloc, free, realloc}
+	};
+
+	Replay replay;
+	if(!load_trace(argv[1], &replay))
+	{
+		return 1;
+	}
+
+	printf("Trace %s : %zu records, %zu calls replayed, %zu frees of blocks allocated before the trace, %zu reordered frees\n",
+		argv[1], replay.nbRecords, replay.nbOps, replay.nbUnmatched, replay.nbReordered);
+	printf("Peak of the memory asked : %.2f MiB\n\n", (double)replay.peakLiveBytes / (1024 * 1024));
+	printf("%-10s %12s %10s %16s %10s\n", "allocator", "time (ms)", "ns/call", "peak rss (MiB)", "overhead");
+
+	int hasFailed = 0;
+	for(size_t i = 0; i < sizeof(allocators) / sizeof(Allocator); ++i)
+	{
+		if(argc > 2 && strcmp(argv[2], allocators[i].name) != 0)
+			continue;
+
+		ReplayResult result;
+		if(!replay_run_process(&replay, &allocators[i], &result))
+		{
+			printf("%-10s failed\n", allocators[i].name);
+			hasFailed = 1;
+			continue;
+		}
+
+		// The overhead is the memory used by the allocator over the memory asked at the peak
+		double peakMib = (double)(result.peakRssKb - result.baseRssKb) / 1024;
+		printf("%-10s %12.2f %10.1f %16.2f %9.2fx\n", allocators[i].name, (double)result.timeNs / 1e6,
+			replay.nbOps > 0 ? (double)result.timeNs / (double)replay.nbOps : 0, peakMib,
+			replay.peakLiveBytes > 0 ? peakMib * 1024 * 1024 / (double)replay.peakLiveBytes : 0);
+	}
+
+	return hasFailed;
+}
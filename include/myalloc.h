@@ -1,54 +1,301 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <time.h>
-#include <unistd.h>
-#include <stdint.h>
-
-void *sbrk(intptr_t increment);
-
-// Memory management functions //
-
-// Returns a pointer to the body of a memory block
-void* myMalloc(size_t size);
-// Frees the block associated to the pointer
-void myFree(void* ptr);
-// Frees the block associated to the pointer and reallocate it for new data
-void* myRealloc(void* ptr, size_t size);
-
-
-// Debug functions //
-
-// Shows the content of a block by displaying the asci representation of each of its bytes
-void print_block_content(void* ptr);
-// Shows which blocks of memory are used ( o for free and x if used)
-void print_small_blocks_used();
-// Prints the list of free large block on the heap with their size, address and header
-void print_large_blocks_used();
-
-
-// Memory reading and writing functions //
-
-// Returns int at a pointer address in memory after checking that the pointer is valid
-int read_safe_int_small(void* ptr);
-// Returns char at a pointer address in memory after checking that the pointer is valid
-char read_safe_char_small(void* ptr);
-// Writes int at a pointer address in memory after checking that the pointer is valid
-void write_safe_int_small(void* ptr,int value);
-// Writes char at a pointer address in memory after checking that the pointer is valid
-void write_safe_char_small(void* ptr,char value);
-
-
-// Test functions //
-
-void test_general();
-void test_free1();
-void test_free2();
-void test_malloc1();
-void test_malloc2();
-void test_realloc();
-void test_header();
-void test_large_block1();
-void test_large_block2();
-void speed_test(size_t testNB);
-
-
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <inttypes.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#if defined(__x86_64__) && defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#endif
+#endif
+
+// Memory management functions //
+
+// Returns a pointer to the body of a memory block
+void* myMalloc(size_t size);
+// Returns a pointer to the body of a memory block aligned on alignment bytes (a power of two)
+void* myAlignedAlloc(size_t alignment, size_t size);
+// Returns a pointer to the body of a memory block of nbElements * size bytes set to zero
+void* myCalloc(size_t nbElements, size_t size);
+// Frees the block associated to the pointer
+void myFree(void* ptr);
+// Frees the block associated to the pointer and reallocate it for new data
+void* myRealloc(void* ptr, size_t size);
+// Frees the block associated to the pointer, allocated with a body of size bytes, faster than myFree for small blocks (the size is not used for the others)
+void myFreeSized(void* ptr, size_t size);
+// Returns the size of the body of the block associated to the pointer, which can be used entirely, or 0 if it is not the body of an in-use block
+size_t myUsableSize(void* ptr);
+// Returns the size of the body of the block that myMalloc would return for size bytes, which can be asked for instead of size at no cost
+size_t myGoodSize(size_t size);
+// Grows the block associated to the pointer without moving it, to maxSize bytes if possible and else to at least minSize bytes
+// Returns the new size of the body, or 0 if it cannot hold minSize bytes without moving
+size_t myTryExpand(void* ptr, size_t minSize, size_t maxSize);
+// Allocates n blocks with bodies of size bytes into out, returns the number of blocks allocated (less than n only if no memory is left)
+size_t myMallocBatch(size_t size, size_t n, void** out);
+// Frees the n blocks of ptrs
+void myFreeBatch(void** ptrs, size_t n);
+// Sets the size from which blocks get their own mapping, given back to the OS when they are freed
+void mySetHugeThreshold(size_t size);
+// Gives the free memory of the heap back to the OS, keeping pad bytes free at the top of the heap, returns 1 if memory was given back
+int myTrim(size_t pad);
+// Sets the delay in milliseconds after which free large blocks give their memory back to the OS (negative to disable, the default)
+void mySetPurgeDelay(long milliseconds);
+
+// Caches of free small blocks : one per thread (the default), one per CPU used with restartable sequences, or one per CPU found with sched_getcpu and locked
+#define PERCPU_OFF 0
+#define PERCPU_RSEQ 1
+#define PERCPU_GETCPU 2
+
+// Keeps the free small blocks in a cache per CPU instead of a cache per thread, or per thread again when isEnabled is 0
+// Restartable sequences are used when the system has registered them, returns the caches now used
+int myPerCpuEnable(int isEnabled);
+
+
+// Arena functions //
+
+// Region of memory whose objects are all freed at once, used by one thread at a time
+typedef struct MyArena_s MyArena;
+
+// Creates an empty arena taking chunks of chunkSize bytes from the allocator (64 KiB when chunkSize is 0)
+MyArena* myArenaCreate(size_t chunkSize);
+// Returns a pointer to size bytes taken from the arena, they cannot be given to myFree
+void* myArenaAlloc(MyArena* arena, size_t size);
+// Frees everything allocated from the arena at once, keeping its chunks for the next allocations
+void myArenaReset(MyArena* arena);
+// Frees everything allocated from the arena and gives its chunks back to the allocator
+void myArenaDestroy(MyArena* arena);
+
+
+// Statistics functions //
+
+// Number of size classes of small blocks
+#define NB_SMALL_CLASSES 20
+
+// Statistics of the small blocks of a size class
+struct MyClassStats_s
+{
+	uint64_t blockSize;
+	uint64_t nbAllocs;
+	uint64_t nbFrees;
+	// Free blocks kept by the caches of the threads or of the CPUs, and free blocks left in the slabs of the class
+	uint64_t nbCached;
+	uint64_t nbFreeInSlabs;
+	uint64_t nbSlabs;
+};
+
+typedef struct MyClassStats_s MyClassStats;
+
+struct MyMallocStats_s
+{
+	// Bytes of the blocks in use, headers included
+	uint64_t bytesInUse;
+	// Peak of the bytes in use, where the free blocks kept by the caches of the threads or of the CPUs count as in use
+	uint64_t peakBytesInUse;
+	// Bytes committed for the heap, the slabs and the huge blocks, and bytes of address space reserved for the heap and the slabs
+	uint64_t bytesMapped;
+	uint64_t bytesReserved;
+
+	MyClassStats classes[NB_SMALL_CLASSES];
+
+	uint64_t nbLargeAllocs;
+	uint64_t nbLargeFrees;
+	uint64_t nbLargeFreeBlocks;
+	uint64_t largeFreeBytes;
+	uint64_t largestFreeBlock;
+	// External fragmentation of the heap, 1 - largestFreeBlock / largeFreeBytes (0 when the free memory is one block)
+	double fragmentation;
+
+	uint64_t nbHugeAllocs;
+	uint64_t nbHugeFrees;
+	uint64_t hugeBytes;
+
+	// System calls made to get memory from the OS and give it back
+	uint64_t nbMmap;
+	uint64_t nbMunmap;
+	uint64_t nbMremap;
+	uint64_t nbMprotect;
+	uint64_t nbMadvise;
+};
+
+typedef struct MyMallocStats_s MyMallocStats;
+
+// Layout of the shared memory segment written by myStatsExport
+// A reader copies stats, and keeps the copy only if sequence was even and has not changed in the meantime
+struct MyStatsSegment_s
+{
+	_Atomic uint64_t sequence;
+	// Time in milliseconds (CLOCK_MONOTONIC) of the last update
+	uint64_t updateTime;
+	MyMallocStats stats;
+};
+
+typedef struct MyStatsSegment_s MyStatsSegment;
+
+// Fills stats with the statistics of the allocator, the counters of every thread are added up without stopping them
+void myMallocStats(MyMallocStats* stats);
+// Writes the statistics every periodMs milliseconds into the shared memory segment name (/dev/shm/name), returns 1 if the export has started
+int myStatsExport(const char* name, long periodMs);
+// Stops the export and removes the segment
+void myStatsExportStop();
+
+
+// Profiling functions //
+
+// Sets the average number of bytes allocated between two blocks sampled by the heap profiler, 0 disables sampling (the default)
+void mySetSampleRate(size_t bytes);
+// Writes the sampled blocks in use with the stacks that allocated them into the file at path, in the heap profile format of pprof
+int myDumpProfile(const char* path);
+// Writes the profile into the file at path every time the process receives signal
+int mySetProfileSignal(int signal, const char* path);
+
+
+// Latency functions //
+
+// Calls measured : myMalloc, myAlignedAlloc and myCalloc are allocations
+#define LATENCY_ALLOC 0
+#define LATENCY_FREE 1
+#define LATENCY_REALLOC 2
+#define LATENCY_NB_CALLS 3
+
+// Slowest path taken by a call : the cache of the thread or of the CPU only, the slabs, the bins of large blocks,
+// a copy of the block by myRealloc, or a system call (growth of the heap or the slabs, huge blocks, purge)
+#define LATENCY_CACHE 0
+#define LATENCY_SLAB 1
+#define LATENCY_LARGE 2
+#define LATENCY_COPY 3
+#define LATENCY_SYSTEM 4
+#define LATENCY_NB_PATHS 5
+
+// Bucket i counts the calls that took from 2^i to 2^(i+1) nanoseconds (bucket 0 from 0), the last one every longer call
+#define LATENCY_BUCKETS 40
+
+struct MyLatencyStats_s
+{
+	uint64_t counts[LATENCY_NB_CALLS][LATENCY_NB_PATHS][LATENCY_BUCKETS];
+};
+
+typedef struct MyLatencyStats_s MyLatencyStats;
+
+// Starts measuring the duration of every call in histograms of each thread, or stops it when isEnabled is 0
+void myLatencyEnable(int isEnabled);
+// Fills stats with the histograms of every thread added up, the calls of exited threads included
+void myLatencyStats(MyLatencyStats* stats);
+// Returns the duration in nanoseconds under which fraction of the calls of a path were (of every path when path is negative)
+// It is the upper bound of a bucket, so it is at most two times too large
+uint64_t myLatencyPercentile(const MyLatencyStats* stats, int call, int path, double fraction);
+// Writes a table of the count, percentiles and maximum of each call and path into fd
+void myLatencyReport(int fd);
+
+
+// Trace functions //
+
+// A trace file is a TraceHeader followed by one TraceRecord per call, the records of each thread are in order but not those of different threads
+#define TRACE_MAGIC "MYATRACE"
+#define TRACE_VERSION 1
+// Records kept by each thread before they are written to the file
+#define TRACE_BUFFER_RECORDS 1024
+// The low bits of TraceRecord.sizeOperation hold the operation and the others the size
+#define TRACE_OPERATION_BITS 8
+
+#define TRACE_MALLOC 1
+#define TRACE_ALIGNED_ALLOC 2
+#define TRACE_CALLOC 3
+#define TRACE_FREE 4
+#define TRACE_REALLOC 5
+
+struct TraceHeader_s
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+};
+
+typedef struct TraceHeader_s TraceHeader;
+
+// One call, the blocks are identified by their address in the traced process
+struct TraceRecord_s
+{
+	// Nanoseconds since the start of the trace
+	uint64_t time;
+	// Size asked (nbElements * size for calloc) and operation
+	uint64_t sizeOperation;
+	// Block returned, or block freed for TRACE_FREE
+	uint64_t ptr;
+	// Block given to TRACE_REALLOC or alignment of TRACE_ALIGNED_ALLOC
+	uint64_t argument;
+};
+
+typedef struct TraceRecord_s TraceRecord;
+
+// Starts recording every allocation and free into the file at path, returns 1 if the trace has started
+int myTraceStart(const char* path);
+// Stops the trace, writing the records of every thread to the file
+void myTraceStop();
+
+
+// Debug functions //
+
+// Shows the content of a block by displaying the asci representation of each of its bytes
+void print_block_content(void* ptr);
+// Shows which blocks of memory are used ( o for free and x if used)
+void print_small_blocks_used();
+// Prints the list of free large block on the heap with their size, address and header
+void print_large_blocks_used();
+
+
+// Memory reading and writing functions //
+
+// Returns int at a pointer address in memory after checking that the pointer is valid
+int read_safe_int_small(void* ptr);
+// Returns char at a pointer address in memory after checking that the pointer is valid
+char read_safe_char_small(void* ptr);
+// Writes int at a pointer address in memory after checking that the pointer is valid
+void write_safe_int_small(void* ptr,int value);
+// Writes char at a pointer address in memory after checking that the pointer is valid
+void write_safe_char_small(void* ptr,char value);
+
+
+// Test functions //
+
+void test_general();
+void test_free1();
+void test_free2();
+void test_malloc1();
+void test_malloc2();
+void test_realloc();
+void test_header();
+void test_large_block1();
+void test_large_block2();
+void test_large_block3();
+void test_expand();
+void test_aligned();
+void test_calloc();
+void test_huge_block();
+void test_trim();
+void test_threads();
+void test_remote_free();
+void test_trace();
+void test_stats();
+void test_profile();
+void test_latency();
+void test_arena();
+void test_batch();
+void test_sizes();
+void test_page_map();
+void test_percpu();
+
+
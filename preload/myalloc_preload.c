@@ -0,0 +1,170 @@
+// Exports the functions of the C library allocator on top of the allocator, so that it can replace it in any program
+// Built as a shared library with the "Preload library" build, then used with LD_PRELOAD=bin/libmyalloc.so
+#include <errno.h>
+
+#include "myalloc.h"
+
+
+// Returns 1 if alignment is a power of two and else 0
+int is_power_of_two(size_t alignment)
+{
+	return alignment != 0 && (alignment & (alignment - 1)) == 0;
+}
+
+
+void* malloc(size_t size)
+{
+	void* ptr = myMalloc(size);
+	if(ptr == NULL)
+		errno = ENOMEM;
+	return ptr;
+}
+
+
+// free(NULL) does nothing, where myFree reports an incorrect address
+void free(void* ptr)
+{
+	if(ptr != NULL)
+		myFree(ptr);
+}
+
+
+// realloc(NULL, size) is malloc(size) and realloc(ptr, 0) frees ptr
+void* realloc(void* ptr, size_t size)
+{
+	if(ptr == NULL)
+		return malloc(size);
+
+	if(size == 0)
+	{
+		myFree(ptr);
+		return NULL;
+	}
+
+	void* newPtr = myRealloc(ptr, size);
+	if(newPtr == NULL)
+		errno = ENOMEM;
+	return newPtr;
+}
+
+
+void* calloc(size_t nbElements, size_t size)
+{
+	void* ptr = myCalloc(nbElements, size);
+	if(ptr == NULL)
+		errno = ENOMEM;
+	return ptr;
+}
+
+
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+	if(!is_power_of_two(alignment) || alignment % sizeof(void*) != 0)
+		return EINVAL;
+
+	void* newPtr = myAlignedAlloc(alignment, size);
+	if(newPtr == NULL)
+		return ENOMEM;
+
+	*ptr = newPtr;
+	return 0;
+}
+
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+	if(!is_power_of_two(alignment))
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	void* ptr = NULL;
+	int error = posix_memalign(&ptr, alignment < sizeof(void*) ? sizeof(void*) : alignment, size);
+	if(error != 0)
+		errno = error;
+	return ptr;
+}
+
+
+void* memalign(size_t alignment, size_t size)
+{
+	return aligned_alloc(alignment, size);
+}
+
+
+void* valloc(size_t size)
+{
+	return aligned_alloc((size_t)sysconf(_SC_PAGESIZE), size);
+}
+
+
+size_t malloc_usable_size(void* ptr)
+{
+	if(ptr == NULL)
+		return 0;
+	return myUsableSize(ptr);
+}
+
+
+// free_sized of C23, size is the size given to malloc or calloc
+void free_sized(void* ptr, size_t size)
+{
+	if(ptr != NULL)
+		myFreeSized(ptr, size);
+}
+
+
+// When MYALLOC_TRACE is set, each process records its calls into the file MYALLOC_TRACE.<pid>, to be replayed with bin/replay
+// When MYALLOC_STATS is set, each process exports its statistics every second into the shared memory segment MYALLOC_STATS.<pid>
+// When MYALLOC_LATENCY is set, the duration of every call is measured and their percentiles are written on the error output when the process exits
+// When MYALLOC_PROFILE is set, one block every MYALLOC_SAMPLE_RATE bytes (512 KiB by default) is sampled, and SIGUSR2 writes the profile to MYALLOC_PROFILE.<pid>
+// When MYALLOC_PERCPU is set, free small blocks are kept by a cache per CPU instead of a cache per thread
+__attribute__((constructor)) void myalloc_preload_init()
+{
+	const char* perCpu = getenv("MYALLOC_PERCPU");
+	if(perCpu != NULL && perCpu[0] != '\0')
+		myPerCpuEnable(1);
+
+	const char* path = getenv("MYALLOC_TRACE");
+	if(path != NULL && path[0] != '\0')
+	{
+		char tracePath[4096];
+		snprintf(tracePath, sizeof(tracePath), "%s.%d", path, (int)getpid());
+		myTraceStart(tracePath);
+	}
+
+	const char* name = getenv("MYALLOC_STATS");
+	if(name != NULL && name[0] != '\0')
+	{
+		char segmentName[256];
+		snprintf(segmentName, sizeof(segmentName), "%s.%d", name, (int)getpid());
+		myStatsExport(segmentName, 1000);
+	}
+
+	const char* profile = getenv("MYALLOC_PROFILE");
+	if(profile != NULL && profile[0] != '\0')
+	{
+		char profilePath[4096];
+		snprintf(profilePath, sizeof(profilePath), "%s.%d", profile, (int)getpid());
+		const char* rate = getenv("MYALLOC_SAMPLE_RATE");
+		mySetSampleRate(rate != NULL ? strtoul(rate, NULL, 10) : 512 * 1024);
+		mySetProfileSignal(SIGUSR2, profilePath);
+	}
+
+	const char* latency = getenv("MYALLOC_LATENCY");
+	if(latency != NULL && latency[0] != '\0')
+		myLatencyEnable(1);
+}
+
+
+// Stops the trace and the export of the statistics and writes the latency report when the process exits
+__attribute__((destructor)) void myalloc_preload_fini()
+{
+	myTraceStop();
+	myStatsExportStop();
+
+	const char* latency = getenv("MYALLOC_LATENCY");
+	if(latency != NULL && latency[0] != '\0')
+		myLatencyReport(STDERR_FILENO);
+}
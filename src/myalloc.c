@@ -1,1010 +1,5786 @@
-#include "myalloc.h"
-
-
-#define MAX_SMALL 100
-#define SIZE_BLK_SMALL 128 - sizeof(size_t)
-
-#define SIZE_BLK_LARGE 1024
-
-// Struct used to represent a block of memory
-struct SmallBlock_s
-{
-	// The LSB of the header tells if the block is in use (LSB = 1) or not (LSB = 0)
-	size_t header;
-	// Body of the block
-	char body[SIZE_BLK_SMALL];
-};
-
-typedef struct SmallBlock_s SmallBlock;
-
-
-struct LargeBlock_s
-{
-	// The LSB of the header tells if the block is in use (LSB = 1) or not (LSB = 0)
-	size_t header;
-	// Size in bytes of the whole block (ie size of body + 2*sizeof(size_t))
-	size_t size;
-	// Body of the block
-	char body[];
-};
-
-
-typedef struct LargeBlock_s LargeBlock;
-
-
-
-
-// The memory
-
-int isInit = 0;
-SmallBlock small_tab[MAX_SMALL];
-
-SmallBlock* firstFreeBlock;
-LargeBlock* big_free = NULL;
-
-
-
-
-
-
-
-
-
-// Returns 1 if the pointer is within the boundaries of memory and else 0
-int is_memory_safe(void* ptr)
-{
-	return ptr >= (void*)((size_t*)small_tab - 1) && ptr < sbrk(0);
-}
-
-
-
-
-
-
-
-
-// Initialize memory headers by setting up the chained list of free blocks
-void initialize_memory()
-{
-	big_free = (LargeBlock*)sbrk(SIZE_BLK_LARGE);
-	if(big_free == (void*)-1)
-	{
-		printf("ERROR : no memory available on the heap.");
-	}
-	big_free->size = SIZE_BLK_LARGE;
-	big_free->header = (size_t)NULL;
-
-	firstFreeBlock = small_tab;
-	for(int i = 0; i < MAX_SMALL - 1; ++i)
-	{
-		*(size_t*)(small_tab + i) = (size_t)(small_tab + i + 1);
-	}
-	*(size_t*)(small_tab+ MAX_SMALL - 1) = (size_t)NULL;
-	isInit = 1;
-}
-
-
-
-
-
-
-
-
-
-// Returns a pointer to the body of a memory block
-void* myMalloc(size_t size)
-{
-	if(!isInit)
-		initialize_memory();
-
-	if(size > SIZE_BLK_SMALL)
-	{
-		// Fullsize is the size of a block with a body size of size
-		size_t fullSize = size + 2*sizeof(size_t);
-
-		// fullSizeMultSize is the size of a block multiple of sizeof(size_t) (for keeping blocks aligned)
-		size_t fullSizeMultSize = ( fullSize / sizeof(size_t) ) * sizeof(size_t);
-		if(fullSizeMultSize < fullSize)
-			fullSizeMultSize += sizeof(size_t);
-
-		LargeBlock* currentLargeBlock = big_free;
-		LargeBlock* prevLargeBlock = NULL;
-
-		// Looping over free large blocks to find one big enough to fit fullSizeMult
-		while(currentLargeBlock != NULL)
-		{
-			if(currentLargeBlock->size >= fullSizeMultSize)
-			{
-				// Here the block is small enough for keeping it intact
-
-				if(currentLargeBlock->size < fullSizeMultSize + SIZE_BLK_SMALL)
-				{
-					if(prevLargeBlock != NULL)
-					{
-						prevLargeBlock->header = currentLargeBlock->header;
-					}
-					else
-					{
-						big_free = (LargeBlock*)currentLargeBlock->header;
-					}
-					currentLargeBlock->header = 1;
-					return (void*)currentLargeBlock->body;
-				}
-				else
-				{
-					// Else, the block is split into two parts to avoid fragmentation
-
-					currentLargeBlock->size -= fullSizeMultSize;
-					LargeBlock* newBlock = (LargeBlock*)((char*)currentLargeBlock + currentLargeBlock->size);
-					newBlock->header = 1;
-					newBlock->size = fullSizeMultSize;
-					return (void*)newBlock->body;
-				}
-			}
-
-			prevLargeBlock = currentLargeBlock;	
-			currentLargeBlock = (LargeBlock*)currentLargeBlock->header;
-		}
-		
-		// If no block large enough is found, memory is allocated on the heap
-
-		LargeBlock* newBlock = (LargeBlock*)sbrk(fullSizeMultSize);
-		if(newBlock == (void*)-1)
-		{
-			printf("ERROR : no memory available on the heap.\n");
-			return NULL;
-		}
-		newBlock->header = 1;
-		newBlock->size = fullSizeMultSize;
-
-		
-		return (void*)newBlock->body;
-		
-
-	}
-
-	// Now I deal with small blocks
-
-	if(firstFreeBlock == NULL)
-	{
-		printf("ERROR : no memory for small blocks available.\n");
-		return NULL;
-	}
-
-	SmallBlock* newBlock = firstFreeBlock;
-	firstFreeBlock = (SmallBlock*)newBlock->header;
-	newBlock->header = 1;
-
-	return newBlock->body;
-
-}
-
-
-
-// Frees the block associated to the pointer
-void myFree(void* ptr)
-{
-	// Here, we check if the pointer points to something after the end of small_tab in memory
-	if(!is_memory_safe(ptr))
-	{
-		printf("ERROR : incorrect address.\n");
-		return;
-	}
-
-	
-	// Small block case : 
-	if(ptr < (void*)(small_tab + MAX_SMALL))
-	{
-		SmallBlock* currentSmallBlock = (SmallBlock*)((size_t*)ptr - 1);
-
-		// In this case, the address does not points to the start of a block
-		if((int)((char*)currentSmallBlock - (char*)small_tab ) % 128 != 0)
-		{
-			printf("ERROR : incorrect address.\n");
-			return;
-		}
-
-		if(!(currentSmallBlock->header & 1))
-		{
-			printf("ERROR : referenced block not in use.\n");
-			return;
-		}
-
-		// Set the header to points to the first free block
-		currentSmallBlock->header = (size_t)firstFreeBlock;
-		firstFreeBlock = currentSmallBlock;
-	}
-	else
-	{
-		// I check if the address header of the block has a LSB of 1 (ie it is used)
-		int isLargeBlock = *((size_t*)ptr - 2) & 1;
-		LargeBlock* freeBlock = (LargeBlock*)((size_t*)ptr - 2);
-
-		// Here I don't check if the address points to the start of the block (With the current global variables, I don't think there is any ways of doing it)
-
-		if(isLargeBlock)
-		{
-			if(big_free == NULL)
-			{
-				big_free = freeBlock;
-				big_free->header = (size_t)NULL;
-				return;
-			}
-
-
-			LargeBlock* currentLargeBlock = big_free;
-			LargeBlock* prevLargeBlock = NULL;
-
-			// I loop over every free block to check if it is adjacent to the block that need to be freed (avoid memory fragmentation)
-			while(currentLargeBlock != NULL)
-			{
-				if( ((char*)currentLargeBlock + currentLargeBlock->size ) == (char*)freeBlock )
-				{
-					currentLargeBlock->size += freeBlock->size;
-					return;
-				}
-
-
-				if( ((char*)freeBlock + freeBlock->size) == (char*)currentLargeBlock )
-				{
-					freeBlock->size += currentLargeBlock->size;
-					freeBlock->header = currentLargeBlock->header;
-					if(prevLargeBlock != NULL)
-					{
-						prevLargeBlock->header = (size_t)freeBlock;
-					}
-					else
-					{
-						big_free = freeBlock;
-					}
-					return;
-				}
-
-				prevLargeBlock = currentLargeBlock;	
-				currentLargeBlock = (LargeBlock*)currentLargeBlock->header;
-			}
-
-			// If no adjacent block found, simply add the block that nedd to be freed to the big_free list
-			freeBlock->header = (size_t)big_free;
-			big_free = freeBlock;
-		}
-		else
-		{
-			printf("ERROR : referenced block not in use.\n");
-			return;
-		}
-	}
-
-}
-
-
-// Frees the block associated to the pointer and reallocate it for new data
-void* myRealloc(void* ptr, size_t size)
-{
-	// Here, we check if the pointer points to something after the end of small_tab in memory
-	if(!is_memory_safe(ptr))
-	{
-		printf("ERROR : incorrect address.\n");
-		return NULL;
-	}
-	
-	size_t bodySize = 0;
-
-	if(ptr < (void*)(small_tab + MAX_SMALL) && *((size_t*)ptr - 1) & 1)
-	{
-		bodySize = SIZE_BLK_SMALL;
-	}
-	if(*((size_t*)ptr - 2) & 1)
-	{
-		bodySize = *((size_t*)ptr - 1) - 2*sizeof(size_t);
-	}
-	if(bodySize == 0)
-	{
-		printf("ERROR : incorrect address or block already in use.\n");
-		return NULL;
-	}
-
-
-	// If the new pointer size is less than the previous pointer size, I try to avoid fragmentation and if not possible, I do nothing
-	if(bodySize > size)
-	{
-		if(bodySize > SIZE_BLK_SMALL && bodySize > size + SIZE_BLK_SMALL + sizeof(size_t))
-		{
-			size_t fullSize = size + 2*sizeof(size_t);
-			size_t fullSizeMultSize = ( fullSize / sizeof(size_t) ) * sizeof(size_t);
-			if(fullSizeMultSize < fullSize)
-				fullSizeMultSize += sizeof(size_t);
-
-			// If the block is too large, I keep the first part of the block for the user (keeping intact the first part of it's data)
-			// and I free the other part
-
-			LargeBlock* currentLargeBlock = (LargeBlock*)((size_t*)ptr - 2);
-			LargeBlock* newBlock = (LargeBlock*)((char*)currentLargeBlock + fullSizeMultSize);
-			newBlock->size = currentLargeBlock->size - fullSizeMultSize;
-			newBlock->header = 1;
-			currentLargeBlock->size = fullSizeMultSize;
-
-			myFree((void*)newBlock->body);
-
-			return (void*)currentLargeBlock->body;
-		}
-		return ptr;
-	}
-
-
-	// The pointer size is too small for the  neww content : I use a malloc-copy-free cycle
-
-	void* newPtr = myMalloc(size);
-
-	if(newPtr == NULL)
-	{
-		printf("ERROR : no memory available.");
-		return NULL;
-	}
-
-	for (size_t i = 0; i < bodySize; i++)
-	{
-		*((char*)newPtr + i) = *((char*)ptr + i);
-	}
-
-	myFree(ptr);
-
-	return newPtr;
-	
-}
-
-
-
-
-
-
-
-
-
-
-
-// Prints the list of free large block on the heap with their size, address and header
-void print_large_blocks_used()
-{
-	LargeBlock* currentLargeBlock = big_free;
-	int counter = 0;
-
-	printf("State of large blocks memory : \n");
-
-	if(big_free == NULL)
-	{
-		printf("No large blocks in big_free.\n");
-	}
-
-	while(currentLargeBlock != NULL)
-	{
-		printf("Large block %d with address %p has a size of %d and a header of %p\n", counter, (void*)currentLargeBlock, (int)currentLargeBlock->size, (void*)currentLargeBlock->header);
-		currentLargeBlock = (LargeBlock*)currentLargeBlock->header;
-		counter++;
-	}
-
-	printf("End of state of large blocks memory.\n");
-	
-}
-
-// Shows which blocks of memory are used ( o for free and x if used)
-void print_small_blocks_used()
-{
-	printf("State of small blocks memory : \n");
-
-	for(int i = 0; i < MAX_SMALL; ++i)
-	{
-		if(small_tab[i].header & 1)
-		{
-			printf("%d : x | ", i);
-		}
-		else
-		{
-			printf("%d : o | ", i);
-		}
-	}
-
-	printf("\nEnd of state of small blocks memory.\n");
-}
-
-
-// Shows the content of a block by displaying the ascii representation of each of its bytes
-void print_block_content(void* ptr)
-{
-	if(ptr < (void*)(small_tab + MAX_SMALL))
-	{
-		void* currentBlock = (void*)((size_t*)ptr - 1);
-		int blockID = (int)( (char*)ptr - (char*)((size_t*)small_tab + 1) ) / 128;
-
-		printf("Content of the %dth small block (address %p) : \n", blockID, currentBlock);
-		for (unsigned int i = 0; i < SIZE_BLK_SMALL; ++i)
-		{
-			printf("%c/", *((char*)ptr + i));
-		}
-		printf("\nEnd of the %dth small block (address %p).\n", blockID, currentBlock);
-	}
-	else
-	{
-		LargeBlock* currentLargeBlock = (LargeBlock*)((size_t*)ptr - 2);
-
-		printf("Content of large block with size %d (address %p) : \n", (int)currentLargeBlock->size, (void*)currentLargeBlock);
-		for (unsigned int i = 0; i < currentLargeBlock->size - 2*sizeof(size_t); ++i)
-		{
-			printf("%c/", *((char*)currentLargeBlock->body + i));
-		}
-		printf("\nEnd of large block with size %d (address %p).\n", (int)currentLargeBlock->size, (void*)currentLargeBlock);
-	}
-}
-
-
-
-
-
-
-
-
-
-
-
-
-
-// Returns int at a pointer address in memory after checking that the pointer is valid
-int read_safe_int_small(void* ptr)
-{
-	if(!is_memory_safe(ptr))
-	{
-		printf("ERROR : incorrect address.\n");
-		return 0;
-	}
-
-	if(ptr > (void*)(small_tab + MAX_SMALL))
-	{
-		printf("ERROR : read_safe_int_small can only read from small blocks.");
-		return 0;
-	}
-
-	// Get the header of the block associated with the pointer, this time the pointer can point anywhere in the body
-	size_t currentHeader = *((size_t*)( (char*)ptr - (char*)(( (char*)ptr - (char*)small_tab ) % 128) ));
-	//                                                ^^^ calculates the number of bytes between the pointer and the start of the block
-	if(!(currentHeader & 1))
-	{
-		printf("ERROR : referenced block not in use.\n");
-		return 0;
-	}
-
-	return *((int*)ptr);
-
-}
-
-// Returns char at a pointer address in memory after checking that the pointer is valid
-char read_safe_char_small(void* ptr)
-{
-	if(!is_memory_safe(ptr))
-	{
-		printf("ERROR : incorrect address.\n");
-		return 0;
-	}
-	if(ptr > (void*)(small_tab + MAX_SMALL))
-	{
-		printf("ERROR : read_safe_char_small can only read from small blocks.");
-		return 0;
-	}
-	// Get the header of the block associated with the pointer, this time the pointer can point anywhere in the body
-	size_t currentHeader = *((size_t*)( (char*)ptr - (char*)(( (char*)ptr - (char*)small_tab ) % 128) ));
-	//                                                ^^^ calculates the number of bytes between the pointer and the start of the block
-	if(!(currentHeader & 1))
-	{
-		printf("ERROR : referenced block not in use.\n");
-		return 0;
-	}
-
-	return *((char*)ptr);
-
-}
-
-// Writes int at a pointer address in memory after checking that the pointer is valid
-void write_safe_int_small(void* ptr,int value)
-{
-	//                          Check if the (int) value is written inside the memory
-	if(!is_memory_safe(ptr) && (void*)((int*)ptr + sizeof(int)) < (void*)(small_tab + MAX_SMALL))
-	{
-		printf("ERROR : incorrect address.\n");
-		return;
-	}
-	if(ptr > (void*)(small_tab + MAX_SMALL))
-	{
-		printf("ERROR : write_safe_int_small can only write in small blocks.");
-		return;
-	}
-	// Get the header of the block associated with the pointer, this time the pointer can point anywhere in the body
-	size_t currentHeader = *((size_t*)( (char*)ptr - (char*)(( (char*)ptr - (char*)small_tab ) % 128) ));
-	//                                                ^^^ calculates the number of bytes between the pointer and the start of the block
-	if(!(currentHeader & 1))
-	{
-		printf("ERROR : referenced block not in use.\n");
-		return;
-	}
-
-	*((int*)ptr) = value;
-
-}
-
-// Writes char at a pointer address in memory after checking that the pointer is valid
-void write_safe_char_small(void* ptr,char value)
-{
-	//                          Check if the (char) value is written inside the memory
-	if(!is_memory_safe(ptr) && (void*)((int*)ptr + sizeof(char)) < (void*)(small_tab + MAX_SMALL))
-	{
-		printf("ERROR : incorrect address.\n");
-		return;
-	}
-	if(ptr > (void*)(small_tab + MAX_SMALL))
-	{
-		printf("ERROR : write_safe_char_small can only write in small blocks.");
-		return;
-	}
-	// Get the header of the block associated with the pointer, this time the pointer can point anywhere in the body
-	size_t currentHeader = *((size_t*)( (char*)ptr - (char*)(( (char*)ptr - (char*)small_tab ) % 128) ));
-	//                                                ^^^ calculates the number of bytes between the pointer and the start of the block
-	if(!(currentHeader & 1))
-	{
-		printf("ERROR : referenced block not in use.\n");
-		return;
-	}
-
-	*((char*)ptr) = value;
-
-}
-
-
-
-
-
-
-
-
-
-
-
-
-
-void test_large_block1()
-{
-	print_small_blocks_used();
-	print_large_blocks_used();
-
-	char* tab = myMalloc(70 * sizeof(char));
-
-	for(int i = 0 ; i < 58; i++)
-	{
-		tab[i] = (char)('A'+i);
-	}
-
-	printf("Malloc array of 70 chars and has written the letters of the alphabet\n");
-
-	print_block_content(tab);
-
-	print_large_blocks_used();
-
-	print_small_blocks_used();
-
-	char* tab2 = myRealloc(tab, sizeof(uint64_t) * 100);
-
-	printf("Realloc the char array to a 100 elements array of 64 bits unsigned integers\n");
-
-	print_block_content(tab2);
-
-	print_large_blocks_used();
-
-	print_small_blocks_used();
-
-	myFree(tab2);
-
-	printf("Free the unsigned int array\n");
-
-	print_large_blocks_used();
-}
-
-void test_large_block2()
-{
-	print_small_blocks_used();
-	print_large_blocks_used();
-
-	char* tab = myMalloc(100 * sizeof(char));
-
-	printf("Malloc array of 100 chars\n");
-
-	print_small_blocks_used();
-
-	uint64_t* tab2 = myMalloc(100 * sizeof(uint64_t));
-
-	printf("Malloc array of 100 uint64_t\n");
-
-	print_large_blocks_used();
-
-	int* tab3 = myMalloc(300 * sizeof(int));
-
-	printf("Malloc array of 300 int\n");
-
-	print_large_blocks_used();
-
-	myFree(tab3);
-
-	printf("Free array of 300 int\n");
-
-	print_large_blocks_used();
-
-	for (size_t i = 0; i < 100; i++)
-	{
-		tab2[i] = i*i;
-	}
-
-	printf("Write squares in uint_64 array\n");
-
-	print_block_content(tab2);
-
-	char* tab4 = myMalloc(128 * sizeof(char));
-
-	printf("Malloc array of 128 chars\n");
-
-	print_large_blocks_used();
-
-
-	float* tab5 = myRealloc(tab2, 10*sizeof(float));
-
-	printf("Realloc array of 100 uint64 to 10 float\n");
-
-	print_block_content(tab5);
-	print_large_blocks_used();
-
-	myFree(tab);
-	printf("Free array of 100 char\n");
-	print_large_blocks_used();
-
-
-	myFree(tab5);
-	printf("Free array of 10 float\n");
-	print_large_blocks_used();
-
-	myFree(tab4);
-	printf("Free array of 128 char\n");
-	print_large_blocks_used();
-
-	print_small_blocks_used();
-
-	printf("Error because i try to free memory that is not in the heap yet :\n");
-	myFree(tab5 + 3000);
-
-
-	
-}
-
-
-
-
-void test_general()
-{
-	printf("Start of memory : %p\n", (void*)small_tab);
-
-	// Alocating an int[5]
-	int* ptr = (int*)( myMalloc(5*sizeof(int)) );
-	printf("Just allocated memory for a 5 int array with body pointer : %p\n", (void*)ptr);
-
-	*(ptr) = 12000;
-	*(ptr + 1) = -100;
-	*(ptr + 2) = 333;
-	*(ptr + 3) = 0;
-	*(ptr + 4) = -3;
-
-	printf("Setting up the value of each element of the array.\n");
-
-
-	write_safe_int_small(ptr + 1, 42);
-	printf("Just wrote int %d at the address : %p\n", 42, (void*)(ptr + 1));
-
-
-
-	print_block_content(ptr);
-
-	for (int i = 0; i < 4; ++i)
-	{
-		// I can print content of the array
-		read_safe_int_small(ptr + i);
-		printf("Just read int %d at the address : %p\n", *((int*)(ptr + i)), (void*)(ptr + i));
-		read_safe_char_small(ptr + i);
-		printf("Just read char %c at the address : %p\n", *((char*)(ptr + i)), (void*)(ptr + i));
-	}
-
-	int* ptr1 = (int*)( myMalloc(sizeof(int)) );
-	printf("Just allocated memory with body pointer : %p\n", (void*)ptr1);
-
-
-
-	myFree((void*)ptr);
-	printf("Just freed block with address : %p\n", (void*)ptr);
-
-	printf("Block is already freed, 8 errors : \n");
-
-	for (int i = 0; i < 4; ++i)
-	{
-		// Error : the block was freed
-		read_safe_int_small(ptr + i);
-		read_safe_char_small(ptr + i);
-	}
-
-	write_safe_int_small(ptr1, -23987);
-	printf("Just wrote int %d at the address : %p\n", -23987, (void*)(ptr1));
-
-	print_block_content(ptr1);
-
-	char* ptr2 = (char*)( myRealloc((void*)ptr1, sizeof(char)) );
-	printf("Just reallocated memory with body pointer : %p \n", (void*)ptr2);
-
-
-	// I reallocate the block associated with ptr1 and use it to store a char @
-	write_safe_char_small(ptr2, '@');
-	printf("Just wrote int %c at the address : %p\n", '@', (void*)ptr2);
-
-
-	// @ can be seen at the first byte of the block 1
-	print_block_content(ptr2);
-
-	// Only 1 is used (0)
-	print_small_blocks_used();
-
-	myFree((void*)ptr2);
-
-	printf("Just freed block with address : %p\n", (void*)ptr2);
-
-	print_small_blocks_used();
-}
-
-void test_free1()
-{
-	int* ptr = (int*)( myMalloc(5*sizeof(int)) );
-	printf("Just allocated memory with body pointer : %p\n", (void*)ptr);
-	char* ptr1 = (char*)( myMalloc(2*sizeof(char)) );
-	printf("Just allocated memory with body pointer : %p\n", (void*)ptr1);
-	myFree(ptr1);
-	printf("Just freed block with address : %p\n", (void*)ptr1);
-	size_t* ptr2 = (size_t*)( myMalloc(sizeof(size_t)) );
-	printf("Just allocated memory with body pointer : %p\n", (void*)ptr2);
-	long* ptr3 = (long*)( myMalloc(3*sizeof(long)) );
-	printf("Just allocated memory with body pointer : %p\n", (void*)ptr3);
-
-	// Only three blocks used
-	print_small_blocks_used();
-
-	myFree(ptr);
-	printf("Just freed block with address : %p\n", (void*)ptr);
-	myFree(ptr3);
-	printf("Just freed block with address : %p\n", (void*)ptr3);
-	myFree(ptr2);
-	printf("Just freed block with address : %p\n", (void*)ptr2);
-
-	// No block used
-	print_small_blocks_used();
-}
-
-void test_free2()
-{
-	char* ptr = (char*)( myMalloc(5*sizeof(char)) );
-	printf("Just allocated memory with body pointer : %p\n", (void*)ptr);
-
-	// One block used
-	print_small_blocks_used();
-
-	myFree(ptr);
-	printf("Just freed block with address : %p\n", (void*)ptr);
-	// Error : already feed
-	printf("Error because the block was already freed : \n");
-	myFree(ptr);
-	printf("Just freed block with address : %p\n", (void*)ptr);
-
-	// No block used
-	print_small_blocks_used();
-}
-
-void test_malloc1()
-{
-	// Here, I try to do a memory overflow
-
-	for (int i = 0; i < MAX_SMALL + 5; ++i)
-	{
-		// OK until i >= MAX_SMALL where there is no memory left
-		long* ptr = (long*)(myMalloc(sizeof(long)));
-		write_safe_int_small(ptr, -i*i*i);
-		if(i < MAX_SMALL)
-		{
-			printf("Just allocated memory with body pointer : %p\n", (void*)ptr);
-			printf("Just wrote int %d at the address : %p\n", -i*i*i, (void*)(ptr));
-		}
-		else
-		{
-			printf("Error because the memory is full.\n");
-		}
-	}
-
-	print_small_blocks_used();
-
-	initialize_memory();
-	printf("Memory reset.\n");
-
-	print_small_blocks_used();
-
-
-}
-
-void test_malloc2()
-{
-	printf("Error because trying to store a 128 int array in a smallblock : \n");
-	int* ptr = (int*)( myMalloc(128*sizeof(int)) );
-	print_small_blocks_used();
-	printf("Error because the int array was never allocated : \n");
-	myFree(ptr);
-}
-
-void test_realloc()
-{
-	int* ptr1 = (int*)myMalloc(sizeof(int));
-	printf("Just allocated memory with body pointer : %p\n", (void*)ptr1);
-    int* ptr2 = (int*)myMalloc(sizeof(int));
-    printf("Just allocated memory with body pointer : %p\n", (void*)ptr2);
-    
-    write_safe_int_small(ptr1, 6789);
-    printf("Just wrote int %d at the address : %p\n", 6789, (void*)(ptr1));
-
-    print_block_content(ptr1);
-
-
-    ptr1 = (int *)myRealloc(ptr1,10 * sizeof(int));
-    printf("Just reallocated memory with body pointer : %p \n", (void*)ptr1);
-
-
-    write_safe_int_small(ptr1, -5);
-    printf("Just wrote int %d at the address : %p\n", -5, (void*)(ptr1));
-    write_safe_int_small(ptr1 + 1, 20);
-    printf("Just wrote int %d at the address : %p\n", 20, (void*)(ptr1+1));
-    write_safe_int_small(ptr1 + 2, -35);
-    printf("Just wrote int %d at the address : %p\n", -35, (void*)(ptr1+2));
-
-    print_block_content(ptr1);
-
-    myFree(ptr1);
-    printf("Just freed block with address : %p\n", (void*)ptr1);
-    myFree(ptr2);
-    printf("Just freed block with address : %p\n", (void*)ptr2);
-
-    print_block_content(ptr1);
-}
-
-
-void test_header()
-{
-	print_small_blocks_used();
-
-	int* test = myMalloc(sizeof(int));
-	printf("Just allocated memory with body pointer : %p\n", (void*)test);
-
-	write_safe_int_small(test, -177);
-	printf("Just wrote int %d at the address : %p\n", -177, (void*)(test));
-
-	print_small_blocks_used();
-
-	char* test2 = myMalloc(sizeof(char)*10);
-	printf("Just allocated memory with body pointer : %p\n", (void*)test2);
-
-	write_safe_int_small(test2, 'E');
-	printf("Just wrote char %c at the address : %p\n", 'E', (void*)(test2));
-
-
-	print_small_blocks_used();
-
-
-	printf("Small tab address : %p\n", (void*)small_tab);
-	printf("First free block address : %p\n", (void*)firstFreeBlock);
-	printf("Number of bytes between small_tab and the first free block : %d\n", (int)((char*)firstFreeBlock - (char*)small_tab));
-	
-
-	myFree(test);
-	printf("Just freed block with address : %p\n", (void*)test);
-
-	printf("First free block address : %p\n", (void*)firstFreeBlock);
-
-	printf("Headers of memory : \n");
-
-	for (size_t i = 0; i < MAX_SMALL; i++)
-	{
-		printf("Header containing address %p at the index %d\n", (void*)(*(size_t*)(small_tab + i)), (int)i);
-	}
-
-	myFree(test2);
-	printf("Just freed block with address : %p\n", (void*)test2);
-
-
-}
-
-
-
-void speed_test(size_t testNB)
-{
-	printf("Small blocks speed test for %u tests : \n", (unsigned int)testNB);
-	int* addresses[MAX_SMALL];
-	clock_t start_time, end_time;
-
-	start_time = clock();
-
-	for (size_t nb = 0; nb < testNB; ++nb)
-	{
-		for (size_t i = 0; i < MAX_SMALL; ++i)
-		{
-			addresses[i] = myMalloc(sizeof(int)*20);
-		}
-		for (size_t i = 0; i < MAX_SMALL; ++i)
-		{
-			myFree(addresses[i]);
-		}
-	}
-	end_time = clock();
-
-
-    printf("Time taken homemade allocator: %f seconds\n", (double)(end_time - start_time) / CLOCKS_PER_SEC);
-
-    start_time = clock();
-
-	for (size_t nb = 0; nb < testNB; ++nb)
-	{
-		for (size_t i = 0; i < MAX_SMALL; ++i)
-		{
-			addresses[i] = malloc(sizeof(int)*20);
-		}
-		for (size_t i = 0; i < MAX_SMALL; ++i)
-		{
-			free(addresses[i]);
-		}
-	}
-	end_time = clock();
-    
-    printf("Time taken stdlib allocator: %f seconds\n", (double)(end_time - start_time) / CLOCKS_PER_SEC);
-
-
-    printf("Large blocks speed test for %u tests : \n", (unsigned int)testNB);
-
-	start_time = clock();
-
-	for (size_t nb = 0; nb < testNB; ++nb)
-	{
-		for (size_t i = 0; i < MAX_SMALL; ++i)
-		{
-			addresses[i] = myMalloc(sizeof(int)*100);
-		}
-		for (size_t i = 0; i < MAX_SMALL; ++i)
-		{
-			myFree(addresses[i]);
-		}
-	}
-	end_time = clock();
-
-	print_large_blocks_used();
-    
-    printf("Time taken homemade allocator: %f seconds\n", (double)(end_time - start_time) / CLOCKS_PER_SEC);
-
-    start_time = clock();
-
-	for (size_t nb = 0; nb < testNB; ++nb)
-	{
-		for (size_t i = 0; i < MAX_SMALL; ++i)
-		{
-			addresses[i] = malloc(sizeof(int)*100);
-		}
-		for (size_t i = 0; i < MAX_SMALL; ++i)
-		{
-			free(addresses[i]);
-		}
-	}
-	end_time = clock();
-    
-    printf("Time taken stdlib allocator: %f seconds\n", (double)(end_time - start_time) / CLOCKS_PER_SEC);
-
-
-}
\ No newline at end of file
+// Needed for mmap flags such as MAP_ANONYMOUS when compiling with -std=c11
+#define _GNU_SOURCE
+
+#include "myalloc.h"
+
+
+// Small blocks are carved from slabs of SLAB_SIZE bytes taken from the OS, each slab being dedicated to one size class
+// Slabs are aligned on SLAB_SIZE so the slab owning a block is found by masking the address of the block
+#define SLAB_SIZE (64 * 1024)
+#define SLAB_HEADER_SIZE 192
+#define SLAB_MAGIC ((size_t)0x51ABB10C51ABB10Cull)
+
+// Alignment of every body, the one compilers expect from malloc
+#define BODY_ALIGN 16
+// The bodies of a size class are aligned on the largest power of two dividing the size of its blocks, up to SMALL_ALIGN_MAX
+#define SMALL_ALIGN_MAX 64
+
+// Size of the largest small block, small blocks have no header so it is also the size of the largest small body
+#define SIZE_SMALL_MAX 1024
+#define SIZE_BLK_SMALL SIZE_SMALL_MAX
+
+// The heap of large blocks is a range of HEAP_RESERVE bytes of address space reserved at initialization
+// It is committed in chunks that double in size, from HEAP_COMMIT_MIN up to HEAP_COMMIT_MAX bytes
+#define HEAP_RESERVE ((size_t)64 << 30)
+#define HEAP_COMMIT_MIN ((size_t)64 << 10)
+#define HEAP_COMMIT_MAX ((size_t)64 << 20)
+// Slabs are carved one after the other from their own reservation of SLAB_RESERVE bytes
+#define SLAB_RESERVE ((size_t)16 << 30)
+
+// Free large blocks are kept in two-level bins : the first level is the position of the most significant bit of the size,
+// the second level splits each power of two in LARGE_SL_COUNT ranges of the same width
+#define LARGE_FL_COUNT 64
+#define LARGE_SL_LOG2 4
+#define LARGE_SL_COUNT (1 << LARGE_SL_LOG2)
+
+// Second bit of the header of an in-use large block, set when the previous block in memory is free
+#define LARGE_PREV_FREE 2
+// Third bit of the header of an in-use block, set when the block has its own mapping (huge block)
+#define LARGE_HUGE 4
+// Fourth bit of the header of an in-use block (small, large or huge), set when the block is sampled by the heap profiler
+#define BLOCK_SAMPLED 8
+
+// Default size from which blocks get their own mapping, can be changed with mySetHugeThreshold
+#define HUGE_THRESHOLD (128 * 1024)
+
+// The page map covers addresses of 48 bits with pages of 2^PAGE_MAP_SHIFT bytes, as many as a root entry and a leaf entry can index
+#define PAGE_MAP_SHIFT 12
+#define PAGE_MAP_LEAF_LOG2 20
+#define PAGE_MAP_LEAF_SIZE ((uintptr_t)1 << PAGE_MAP_LEAF_LOG2)
+#define PAGE_MAP_ROOT_SIZE ((uintptr_t)1 << (48 - PAGE_MAP_SHIFT - PAGE_MAP_LEAF_LOG2))
+
+// Time when a free large block was last written, for blocks whose pages have already been given back to the OS
+#define LARGE_CLEAN 0
+// Time used for written free blocks when purging is disabled, older than any real time
+#define LARGE_DIRTY 1
+// Size of the smallest large block, a free one holds the links of its bin, its free time and its footer
+#define LARGE_MIN_SIZE 48
+
+// Number of blocks moved at once between a thread cache and the slabs, and maximum number of blocks a thread cache keeps per class
+#define CACHE_BATCH 32
+#define CACHE_MAX (2 * CACHE_BATCH)
+
+// Free small block, the body of a small block has no header and starts at the start of the block
+// Whether a block is in use is kept out of the block, in the states of its slab
+struct SmallBlock_s
+{
+	// Next free block of the same list (in the slab, in the cache of a thread or of a CPU, or in the remoteFree list of the slab)
+	struct SmallBlock_s* nextFree;
+	// Number of blocks of the list from this one, only kept in the caches of the CPUs (the smallest blocks have room for it)
+	size_t listLength;
+};
+
+typedef struct SmallBlock_s SmallBlock;
+
+// State of a small block, one byte per block stored after the header of its slab
+// A byte per block instead of a bit lets two threads change the states of neighbour blocks without any atomic operation
+#define BLOCK_IN_USE 1
+
+
+// Header stored at the start of every slab, followed by the states of the blocks
+// The blocks start after them at the offset of their size class
+// The fields read by every myFree never change and are kept away from the cache line of the fields written under the class lock
+struct Slab_s
+{
+	// Always SLAB_MAGIC, used to check that an address really belongs to a slab
+	size_t magic;
+	int sizeClass;
+	// Number of blocks carved in the slab
+	int nbBlocks;
+
+	// Number of blocks given to thread caches (used or cached)
+	_Alignas(64) int nbUsed;
+	// Chained list of the free blocks of the slab
+	SmallBlock* firstFreeBlock;
+	// Next slab of the same class that still has free blocks
+	struct Slab_s* nextPartial;
+	// Next slab in the list of every slab
+	struct Slab_s* nextSlab;
+
+	// Blocks given back by thread caches without any lock, chained like those of firstFreeBlock
+	// The list is taken as a whole by the next thread that refills its cache from this class
+	_Alignas(64) SmallBlock* _Atomic remoteFree;
+	// Next slab of the same class with blocks in remoteFree
+	struct Slab_s* nextRemote;
+};
+
+typedef struct Slab_s Slab;
+
+_Static_assert(sizeof(Slab) <= SLAB_HEADER_SIZE, "Slab header does not fit in SLAB_HEADER_SIZE");
+
+
+struct LargeBlock_s
+{
+	// The LSB of the header tells if the block is in use (LSB = 1) or not (LSB = 0)
+	// When the block is used, the second bit tells if the previous block in memory is free (LARGE_PREV_FREE)
+	// When the block is free, the header is the address of the next free block of the same bin
+	size_t header;
+	// Size in bytes of the whole block (ie size of body + 2*sizeof(size_t))
+	size_t size;
+	// Body of the block, when the block is free its first bytes hold the address of the previous free block of the same bin
+	// and the time in milliseconds when the block was last written, its last bytes hold the size of the block (footer), so the next block can find it
+	char body[];
+};
+
+
+typedef struct LargeBlock_s LargeBlock;
+
+
+// Header of a block that has its own mapping, released with munmap when the block is freed
+// The last two fields are at the same place as in a large block, so the size of the body is found the same way
+struct HugeBlock_s
+{
+	// Chained list of every huge block
+	struct HugeBlock_s* next;
+	struct HugeBlock_s* prev;
+	// Always 1 | LARGE_HUGE
+	size_t header;
+	// Size in bytes of the mapping from the header without next and prev (ie size of body + 2*sizeof(size_t))
+	size_t size;
+	// Body of the block
+	char body[];
+};
+
+typedef struct HugeBlock_s HugeBlock;
+
+
+// Range of address space reserved at initialization, only the part before commitEnd can be read and written
+struct Reservation_s
+{
+	char* start;
+	// End of the part in use, read without lock to know if an address belongs to the reservation
+	char* _Atomic end;
+	char* commitEnd;
+	char* reserveEnd;
+};
+
+typedef struct Reservation_s Reservation;
+
+
+
+
+// The memory
+
+_Atomic int isInit = 0;
+
+// Size in bytes of the blocks of each class
+const size_t small_class_size[NB_SMALL_CLASSES] = {16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 896, 1024};
+// Size class of a body of n bytes is small_class_lookup[(n + 7) / 8]
+unsigned char small_class_lookup[SIZE_BLK_SMALL / 8 + 1];
+// Alignment of the bodies of each class, offset of the first block of each class in its slabs and number of blocks of its slabs
+size_t small_class_align[NB_SMALL_CLASSES];
+size_t small_class_offset[NB_SMALL_CLASSES];
+int small_class_nb_blocks[NB_SMALL_CLASSES];
+// The block at offset bytes from the first block of its slab is block (offset * small_class_inverse[sizeClass]) >> 32, without any division
+// It is exact for every offset below 2^16 = SLAB_SIZE, as the error is below 2^-16 and the fractional part of offset / size is at most 1 - 1/1024
+uint64_t small_class_inverse[NB_SMALL_CLASSES];
+
+// One chained list per size class of the slabs that still have free blocks
+Slab* partialSlabs[NB_SMALL_CLASSES];
+// One lock-free stack per size class of the slabs with blocks in their remoteFree list
+Slab* _Atomic remoteSlabs[NB_SMALL_CLASSES];
+// Each class has its own lock, taken only when a thread cache is refilled or flushed
+pthread_mutex_t classLocks[NB_SMALL_CLASSES];
+// Every slab ever taken from the reservation of slabs (protected by slabLock)
+pthread_mutex_t slabLock = PTHREAD_MUTEX_INITIALIZER;
+Slab* allSlabs = NULL;
+int nbSlabs = 0;
+Reservation slabSpace;
+
+// Heap used for large blocks, it always ends with an epilogue : an in-use header of size 0
+// The memory between heap.end and heap.commitEnd can be used without any system call
+// Everything about large blocks is protected by largeLock
+Reservation heap;
+pthread_mutex_t largeLock = PTHREAD_MUTEX_INITIALIZER;
+// The heap after heapDirtyEnd has never been written since it was committed, so it holds only zeros
+char* heapDirtyEnd = NULL;
+// Part of the body of the last block returned by large_malloc known to hold only zeros
+char* largeZeroStart = NULL;
+char* largeZeroEnd = NULL;
+// Delay in milliseconds after which the pages of free large blocks are given back to the OS (negative when disabled)
+long purgeDelay = -1;
+uint64_t nextPurgeTime = 0;
+
+// Bitmap of the in-use large blocks, one bit per BODY_ALIGN bytes of the heap set for the body of each in-use block
+// It is committed along with the heap and changed under largeLock, so that a pointer is checked to be the body of a block before its header is read
+Reservation largeMarks;
+
+// Every huge block, protected by hugeLock
+pthread_mutex_t hugeLock = PTHREAD_MUTEX_INITIALIZER;
+HugeBlock* hugeBlocks = NULL;
+// Page map giving the huge block of every page of a huge mapping, a radix tree with a root of PAGE_MAP_ROOT_SIZE entries
+// Each entry of the root points to a leaf of PAGE_MAP_LEAF_SIZE pages, mapped the first time a huge block uses one of them
+// The slabs and the heap are reservations found from their bounds, so the page map only holds the mappings of huge blocks
+// It is changed under hugeLock and read without any lock
+HugeBlock* _Atomic* _Atomic pageMap[PAGE_MAP_ROOT_SIZE];
+size_t hugeThreshold = HUGE_THRESHOLD;
+size_t pageSize = 4096;
+
+// Bins of free large blocks, a bit is set in the bitmaps for every non empty bin
+LargeBlock* largeBins[LARGE_FL_COUNT][LARGE_SL_COUNT];
+uint64_t largeFlBitmap = 0;
+uint32_t largeSlBitmap[LARGE_FL_COUNT];
+
+
+// Indices of the counters of each thread : allocations and frees of small blocks of each class, then of large and huge blocks
+#define STAT_SMALL_ALLOCS 0
+#define STAT_SMALL_FREES NB_SMALL_CLASSES
+#define STAT_LARGE_ALLOCS (2 * NB_SMALL_CLASSES)
+#define STAT_LARGE_FREES (STAT_LARGE_ALLOCS + 1)
+#define STAT_HUGE_ALLOCS (STAT_LARGE_ALLOCS + 2)
+#define STAT_HUGE_FREES (STAT_LARGE_ALLOCS + 3)
+#define NB_THREAD_STATS (STAT_LARGE_ALLOCS + 4)
+
+// Free small blocks kept by a thread, used without any lock
+struct ThreadCache_s
+{
+	// One chained list of free blocks per size class and its length
+	SmallBlock* firstFreeBlock[NB_SMALL_CLASSES];
+	int nbFree[NB_SMALL_CLASSES];
+	// 1 once the cache is registered to be flushed when the thread exits
+	int isRegistered;
+	// Counters written only by the thread, and read by myMallocStats from any thread
+	_Atomic uint64_t stats[NB_THREAD_STATS];
+	// Chained list of the caches of the running threads, protected by statsLock
+	struct ThreadCache_s* prevCache;
+	struct ThreadCache_s* nextCache;
+};
+
+typedef struct ThreadCache_s ThreadCache;
+
+// The initial-exec model keeps the first access from a new thread from allocating memory when the allocator is preloaded
+_Thread_local ThreadCache threadCache __attribute__((tls_model("initial-exec")));
+pthread_key_t threadCacheKey;
+pthread_once_t initOnce = PTHREAD_ONCE_INIT;
+
+// Caches of the running threads, and the counters of the threads that exited, protected by statsLock
+pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+ThreadCache* threadCaches = NULL;
+uint64_t exitedStats[NB_THREAD_STATS];
+
+// Small blocks of each class taken out of the slabs (in use or kept by a thread cache) and slabs of each class
+_Atomic uint64_t classBlocksOut[NB_SMALL_CLASSES];
+_Atomic uint64_t classNbSlabs[NB_SMALL_CLASSES];
+// Bytes taken out of the slabs, of the in-use large blocks and of the huge mappings, and the peak of their sum
+_Atomic uint64_t smallOutBytes = 0;
+_Atomic uint64_t largeInUseBytes = 0;
+_Atomic uint64_t hugeBytes = 0;
+_Atomic uint64_t peakBytes = 0;
+// Free large blocks in the bins and their bytes, protected by largeLock
+uint64_t nbLargeFreeBlocks = 0;
+uint64_t largeFreeBytes = 0;
+// System calls made to get memory from the OS or give it back
+_Atomic uint64_t nbMmapCalls = 0;
+_Atomic uint64_t nbMunmapCalls = 0;
+_Atomic uint64_t nbMremapCalls = 0;
+_Atomic uint64_t nbMprotectCalls = 0;
+_Atomic uint64_t nbMadviseCalls = 0;
+// Slowest path taken by the current call of the thread, read when the duration of the call is measured
+_Thread_local int latencyPath __attribute__((tls_model("initial-exec"))) = 0;
+// 1 while the thread is inside a measured call, so that the calls it makes to the other functions are not measured
+_Thread_local int isInTimedCall __attribute__((tls_model("initial-exec"))) = 0;
+
+
+
+
+
+
+
+
+
+// Defined with the thread caches
+void register_thread_cache();
+
+// Writes an error message on the standard error output without allocating any memory
+// printf may call malloc, which is myMalloc itself when the allocator is preloaded
+void print_error(const char* message)
+{
+	ssize_t written = write(STDERR_FILENO, message, strlen(message));
+	(void)written;
+}
+
+
+// Adds nbEvents to a counter of the current thread, only the thread writes it so no atomic addition is needed
+// The thread is registered first, so that its counters are read by myMallocStats and kept when it exits
+void count_events(int stat, uint64_t nbEvents)
+{
+	if(!threadCache.isRegistered)
+		register_thread_cache();
+	uint64_t value = atomic_load_explicit(&threadCache.stats[stat], memory_order_relaxed);
+	atomic_store_explicit(&threadCache.stats[stat], value + nbEvents, memory_order_relaxed);
+}
+
+
+// Adds one to a counter of the current thread
+void count_event(int stat)
+{
+	count_events(stat, 1);
+}
+
+
+// Raises the peak of the bytes in use to the current bytes in use
+void update_peak()
+{
+	uint64_t inUse = atomic_load_explicit(&smallOutBytes, memory_order_relaxed) + atomic_load_explicit(&largeInUseBytes, memory_order_relaxed)
+		+ atomic_load_explicit(&hugeBytes, memory_order_relaxed);
+	uint64_t peak = atomic_load_explicit(&peakBytes, memory_order_relaxed);
+	while(inUse > peak && !atomic_compare_exchange_weak_explicit(&peakBytes, &peak, inUse, memory_order_relaxed, memory_order_relaxed))
+	{
+	}
+}
+
+
+// Counts size more bytes of in-use large blocks (size is negative when they are freed), largeLock must be held
+void add_large_in_use(int64_t size)
+{
+	atomic_store_explicit(&largeInUseBytes, atomic_load_explicit(&largeInUseBytes, memory_order_relaxed) + (uint64_t)size, memory_order_relaxed);
+	if(size > 0)
+		update_peak();
+}
+
+
+// Records that the current call of the thread takes a path at least as slow as path, when the call is measured
+void mark_latency_path(int path)
+{
+	if(isInTimedCall && latencyPath < path)
+		latencyPath = path;
+}
+
+
+// Counts a system call made for the memory of the blocks, the slowest path a call can take
+void count_system_call(_Atomic uint64_t* counter)
+{
+	(*counter)++;
+	mark_latency_path(LATENCY_SYSTEM);
+}
+
+
+// Returns 1 if the pointer is within the slabs taken from the reservation of slabs and else 0
+int is_slab_address(void* ptr)
+{
+	return (char*)ptr >= slabSpace.start && (char*)ptr < slabSpace.end;
+}
+
+// Returns 1 if the pointer is within the blocks of the heap and else 0
+int is_heap_address(void* ptr)
+{
+	return (char*)ptr >= heap.start && (char*)ptr < heap.end;
+}
+
+
+// Returns the word of the bitmap of in-use large blocks holding the bit of the body starting at ptr, and writes the bit in bit
+_Atomic uint64_t* large_mark_word(void* ptr, uint64_t* bit)
+{
+	size_t index = (size_t)((char*)ptr - heap.start) / BODY_ALIGN;
+	*bit = (uint64_t)1 << (index % 64);
+	return (_Atomic uint64_t*)largeMarks.start + index / 64;
+}
+
+
+// Marks a large block as in use (isInUse = 1) or not (isInUse = 0), largeLock must be held
+void set_large_mark(LargeBlock* block, int isInUse)
+{
+	uint64_t bit;
+	_Atomic uint64_t* word = large_mark_word(block->body, &bit);
+	uint64_t marks = atomic_load_explicit(word, memory_order_relaxed);
+	atomic_store_explicit(word, isInUse ? marks | bit : marks & ~bit, memory_order_relaxed);
+}
+
+
+// Returns 1 if ptr is the body of an in-use large block and else 0, without reading anything outside the bitmap
+int is_large_body(void* ptr)
+{
+	if(!is_heap_address(ptr) || ((uintptr_t)ptr & (BODY_ALIGN - 1)) != 0)
+	{
+		return 0;
+	}
+
+	uint64_t bit;
+	return (atomic_load_explicit(large_mark_word(ptr, &bit), memory_order_relaxed) & bit) != 0;
+}
+
+
+// Returns the huge block whose mapping holds the address ptr, or NULL if ptr is not in a huge mapping
+HugeBlock* huge_block_of(void* ptr)
+{
+	uintptr_t page = (uintptr_t)ptr >> PAGE_MAP_SHIFT;
+	if(page >= PAGE_MAP_ROOT_SIZE * PAGE_MAP_LEAF_SIZE)
+	{
+		return NULL;
+	}
+
+	HugeBlock* _Atomic* leaf = atomic_load_explicit(&pageMap[page >> PAGE_MAP_LEAF_LOG2], memory_order_acquire);
+	if(leaf == NULL)
+	{
+		return NULL;
+	}
+	return atomic_load_explicit(&leaf[page & (PAGE_MAP_LEAF_SIZE - 1)], memory_order_relaxed);
+}
+
+
+// Maps the leaves of the page map needed by the pages from start to start + size, hugeLock must be held
+// Returns 0 if the range is out of the page map or if the system has no memory left
+int map_page_leaves(void* start, size_t size)
+{
+	uintptr_t lastPage = ((uintptr_t)start + size - 1) >> PAGE_MAP_SHIFT;
+	if(lastPage >= PAGE_MAP_ROOT_SIZE * PAGE_MAP_LEAF_SIZE)
+	{
+		return 0;
+	}
+
+	for(uintptr_t i = ((uintptr_t)start >> PAGE_MAP_SHIFT) >> PAGE_MAP_LEAF_LOG2; i <= lastPage >> PAGE_MAP_LEAF_LOG2; ++i)
+	{
+		if(atomic_load_explicit(&pageMap[i], memory_order_relaxed) != NULL)
+		{
+			continue;
+		}
+
+		// The pages of a leaf are only used when a huge block is mapped in its range
+		HugeBlock* _Atomic* leaf = mmap(NULL, PAGE_MAP_LEAF_SIZE * sizeof(HugeBlock*), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		count_system_call(&nbMmapCalls);
+		if(leaf == MAP_FAILED)
+		{
+			return 0;
+		}
+		atomic_store_explicit(&pageMap[i], leaf, memory_order_release);
+	}
+
+	return 1;
+}
+
+
+// Makes the pages from start to start + size belong to a huge block, or to nothing when hugeBlock is NULL
+// The leaves must have been mapped by map_page_leaves, hugeLock must be held
+void set_page_map(void* start, size_t size, HugeBlock* hugeBlock)
+{
+	uintptr_t endPage = ((uintptr_t)start + size - 1) >> PAGE_MAP_SHIFT;
+	for(uintptr_t page = (uintptr_t)start >> PAGE_MAP_SHIFT; page <= endPage; ++page)
+	{
+		atomic_store_explicit(&pageMap[page >> PAGE_MAP_LEAF_LOG2][page & (PAGE_MAP_LEAF_SIZE - 1)], hugeBlock, memory_order_relaxed);
+	}
+}
+
+
+// Returns 1 if the pointer is within the mapping of a huge block and else 0
+int is_huge_address(void* ptr)
+{
+	return huge_block_of(ptr) != NULL;
+}
+
+// Returns 1 if the pointer is within the boundaries of memory and else 0
+int is_memory_safe(void* ptr)
+{
+	if(!isInit)
+		return 0;
+	return is_heap_address(ptr) || is_slab_address(ptr) || is_huge_address(ptr);
+}
+
+
+
+
+
+
+
+
+// Defined with the thread cache functions, registered as the destructor of the thread caches
+void flush_thread_cache(void* cache);
+
+// Reserves size bytes of address space aligned on align bytes, a smaller reservation is tried if the system refuses it
+// Returns 0 if nothing could be reserved
+int reserve_space(Reservation* space, size_t size, size_t align)
+{
+	char* region = MAP_FAILED;
+	while(region == MAP_FAILED && size >= HEAP_COMMIT_MIN)
+	{
+		region = mmap(NULL, size + align, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		count_system_call(&nbMmapCalls);
+		if(region == MAP_FAILED)
+			size /= 2;
+	}
+
+	if(region == MAP_FAILED)
+	{
+		return 0;
+	}
+
+	space->start = (char*)(((uintptr_t)region + align - 1) & ~(uintptr_t)(align - 1));
+	space->end = space->start;
+	space->commitEnd = space->start;
+	space->reserveEnd = space->start + size;
+	return 1;
+}
+
+
+// Makes at least size more bytes of a reservation usable, and at least as much as what is already committed
+// Returns 0 if the reservation is full or if the system has no memory left
+int commit_space(Reservation* space, size_t size)
+{
+	size_t commitSize = (size_t)(space->commitEnd - space->start);
+	if(commitSize < HEAP_COMMIT_MIN)
+		commitSize = HEAP_COMMIT_MIN;
+	if(commitSize > HEAP_COMMIT_MAX)
+		commitSize = HEAP_COMMIT_MAX;
+	if(commitSize < size)
+		commitSize = (size + pageSize - 1) / pageSize * pageSize;
+
+	if(commitSize > (size_t)(space->reserveEnd - space->commitEnd))
+	{
+		commitSize = (size_t)(space->reserveEnd - space->commitEnd);
+		if(commitSize < size)
+			return 0;
+	}
+
+	count_system_call(&nbMprotectCalls);
+	if(mprotect(space->commitEnd, commitSize, PROT_READ | PROT_WRITE) != 0)
+	{
+		return 0;
+	}
+	space->commitEnd += commitSize;
+
+	return 1;
+}
+
+
+// Makes sure the bitmap of in-use large blocks covers a heap ending at end, largeLock must be held
+// Returns 0 if the system has no memory left
+int commit_large_marks(char* end)
+{
+	char* marksEnd = largeMarks.start + ((size_t)(end - heap.start) / BODY_ALIGN + 63) / 64 * sizeof(uint64_t);
+	return marksEnd <= largeMarks.commitEnd || commit_space(&largeMarks, (size_t)(marksEnd - largeMarks.commitEnd));
+}
+
+
+// Initialize memory headers by reserving the heap and the slabs and setting up the size classes lookup table and the locks
+// Called only once, through pthread_once
+void initialize_memory()
+{
+	pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+	if(!reserve_space(&heap, HEAP_RESERVE, pageSize) || !reserve_space(&slabSpace, SLAB_RESERVE, SLAB_SIZE)
+		|| !reserve_space(&largeMarks, (size_t)(heap.reserveEnd - heap.start) / (BODY_ALIGN * 8), pageSize))
+	{
+		print_error("ERROR : no memory available on the heap.\n");
+	}
+	else if(commit_space(&heap, sizeof(LargeBlock)) && commit_large_marks(heap.start + sizeof(LargeBlock)))
+	{
+		// The heap starts with its epilogue alone
+		LargeBlock* epilogue = (LargeBlock*)heap.start;
+		epilogue->header = 1;
+		epilogue->size = 0;
+		heap.end = heap.start + sizeof(LargeBlock);
+		heapDirtyEnd = heap.end;
+	}
+
+	// The class of a body is the smallest class whose blocks can hold the body
+	int currentClass = 0;
+	for(size_t i = 0; i <= SIZE_BLK_SMALL / 8; ++i)
+	{
+		while(small_class_size[currentClass] < i * 8)
+		{
+			currentClass++;
+		}
+		small_class_lookup[i] = (unsigned char)currentClass;
+	}
+
+	for(int i = 0; i < NB_SMALL_CLASSES; ++i)
+	{
+		small_class_align[i] = small_class_size[i] & -small_class_size[i];
+		if(small_class_align[i] > SMALL_ALIGN_MAX)
+			small_class_align[i] = SMALL_ALIGN_MAX;
+
+		// As many blocks as possible with their state byte, the first block is aligned after the states
+		int nbBlocks = (int)((SLAB_SIZE - SLAB_HEADER_SIZE) / (small_class_size[i] + 1));
+		size_t offset;
+		while((offset = (SLAB_HEADER_SIZE + (size_t)nbBlocks + small_class_align[i] - 1) / small_class_align[i] * small_class_align[i])
+			+ (size_t)nbBlocks * small_class_size[i] > SLAB_SIZE)
+		{
+			nbBlocks--;
+		}
+		small_class_offset[i] = offset;
+		small_class_nb_blocks[i] = nbBlocks;
+		small_class_inverse[i] = (((uint64_t)1 << 32) + small_class_size[i] - 1) / small_class_size[i];
+
+		partialSlabs[i] = NULL;
+		remoteSlabs[i] = NULL;
+		pthread_mutex_init(&classLocks[i], NULL);
+	}
+	pthread_key_create(&threadCacheKey, flush_thread_cache);
+	isInit = 1;
+}
+
+
+// Defined with the functions that find the slab of an address
+unsigned char* slab_states(Slab* slab);
+
+// Takes a new slab from the reservation of slabs for a size class and sets up the chained list of its free blocks
+// The lock of the class must be held, returns NULL if the reservation is full or the OS has no memory left
+Slab* add_slab(int sizeClass)
+{
+	pthread_mutex_lock(&slabLock);
+	if(slabSpace.end == NULL || (slabSpace.end == slabSpace.commitEnd && !commit_space(&slabSpace, SLAB_SIZE)))
+	{
+		pthread_mutex_unlock(&slabLock);
+		return NULL;
+	}
+	// No block of the slab can be given to myFree before the slab is set up, so it can be counted in the reservation right away
+	char* start = slabSpace.end;
+	slabSpace.end = start + SLAB_SIZE;
+	pthread_mutex_unlock(&slabLock);
+
+	Slab* slab = (Slab*)start;
+	size_t blockSize = small_class_size[sizeClass];
+	char* blocks = start + small_class_offset[sizeClass];
+	int nbBlocks = small_class_nb_blocks[sizeClass];
+
+	for(int i = 0; i < nbBlocks - 1; ++i)
+	{
+		((SmallBlock*)(blocks + i * blockSize))->nextFree = (SmallBlock*)(blocks + (i + 1) * blockSize);
+	}
+	((SmallBlock*)(blocks + (nbBlocks - 1) * blockSize))->nextFree = NULL;
+	memset(slab_states(slab), 0, (size_t)nbBlocks);
+
+	slab->magic = SLAB_MAGIC;
+	slab->sizeClass = sizeClass;
+	slab->nbBlocks = nbBlocks;
+	slab->nbUsed = 0;
+	slab->firstFreeBlock = (SmallBlock*)blocks;
+	slab->remoteFree = NULL;
+	slab->nextRemote = NULL;
+	slab->nextPartial = partialSlabs[sizeClass];
+	partialSlabs[sizeClass] = slab;
+	classNbSlabs[sizeClass]++;
+
+	pthread_mutex_lock(&slabLock);
+	slab->nextSlab = allSlabs;
+	allSlabs = slab;
+	nbSlabs++;
+	pthread_mutex_unlock(&slabLock);
+
+	return slab;
+}
+
+
+// Returns the address of the first block of a slab
+char* slab_blocks(Slab* slab)
+{
+	return (char*)slab + small_class_offset[slab->sizeClass];
+}
+
+
+// Returns the states of the blocks of a slab, one byte per block
+unsigned char* slab_states(Slab* slab)
+{
+	return (unsigned char*)slab + SLAB_HEADER_SIZE;
+}
+
+
+// Returns the slab containing the address ptr, or NULL if ptr is not in a slab
+Slab* slab_of(void* ptr)
+{
+	if(!is_slab_address(ptr))
+	{
+		return NULL;
+	}
+
+	Slab* slab = (Slab*)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+	if(slab->magic != SLAB_MAGIC)
+	{
+		return NULL;
+	}
+	return slab;
+}
+
+
+// Returns the state of the small block containing the address ptr (anywhere in its body), or NULL if ptr is not in a small block
+// When block is not NULL, the address of the start of the block is written in it
+unsigned char* small_block_state(void* ptr, SmallBlock** block)
+{
+	Slab* slab = slab_of(ptr);
+	if(slab == NULL || (char*)ptr < slab_blocks(slab))
+	{
+		return NULL;
+	}
+
+	size_t offset = (size_t)((char*)ptr - slab_blocks(slab));
+	size_t index = (size_t)((offset * small_class_inverse[slab->sizeClass]) >> 32);
+
+	// The end of the slab may be too short to hold a whole block
+	if(index >= (size_t)slab->nbBlocks)
+	{
+		return NULL;
+	}
+
+	if(block != NULL)
+		*block = (SmallBlock*)(slab_blocks(slab) + index * small_class_size[slab->sizeClass]);
+	return slab_states(slab) + index;
+}
+
+
+// Returns the state of the small block starting at ptr, or NULL if ptr is not the start of a small block
+unsigned char* small_body_state(void* ptr)
+{
+	SmallBlock* block;
+	unsigned char* state = small_block_state(ptr, &block);
+	return state != NULL && (void*)block == ptr ? state : NULL;
+}
+
+
+// Returns the state of a block of a size class, known to be the start of a small block
+unsigned char* small_class_state(SmallBlock* block, int sizeClass)
+{
+	char* slab = (char*)((uintptr_t)block & ~(uintptr_t)(SLAB_SIZE - 1));
+	size_t offset = (size_t)((char*)block - slab) - small_class_offset[sizeClass];
+	return (unsigned char*)slab + SLAB_HEADER_SIZE + ((offset * small_class_inverse[sizeClass]) >> 32);
+}
+
+
+// Returns the small block containing the address ptr (anywhere in its body), or NULL if ptr is not in a small block
+SmallBlock* small_block_of(void* ptr)
+{
+	SmallBlock* block;
+	return small_block_state(ptr, &block) != NULL ? block : NULL;
+}
+
+
+
+// Takes the remoteFree lists of every slab of a class and puts their blocks back in the free lists of the slabs
+// The lock of the class must be held
+void drain_remote_frees(int sizeClass)
+{
+	Slab* slab = atomic_exchange(&remoteSlabs[sizeClass], NULL);
+
+	while(slab != NULL)
+	{
+		// nextRemote must be read before the list is taken, as a thread may push the slab again right after
+		Slab* nextSlab = slab->nextRemote;
+		SmallBlock* firstBlock = atomic_exchange(&slab->remoteFree, NULL);
+
+		if(firstBlock != NULL)
+		{
+			SmallBlock* lastBlock = firstBlock;
+			int nbBlocks = 1;
+			while(lastBlock->nextFree != NULL)
+			{
+				lastBlock = lastBlock->nextFree;
+				nbBlocks++;
+			}
+
+			// A full slab gets back in the list of slabs with free blocks
+			if(slab->firstFreeBlock == NULL)
+			{
+				slab->nextPartial = partialSlabs[sizeClass];
+				partialSlabs[sizeClass] = slab;
+			}
+
+			lastBlock->nextFree = slab->firstFreeBlock;
+			slab->firstFreeBlock = firstBlock;
+			slab->nbUsed -= nbBlocks;
+		}
+
+		slab = nextSlab;
+	}
+}
+
+
+// Moves free blocks of a class from the slabs to the cache of the current thread, until it holds nbWanted blocks
+// Returns the first free block of the cache, or NULL if the OS has no memory left
+SmallBlock* refill_thread_cache(int sizeClass, int nbWanted)
+{
+	// The cache is flushed back to the slabs when the thread exits
+	if(!threadCache.isRegistered)
+		register_thread_cache();
+	mark_latency_path(LATENCY_SLAB);
+
+	pthread_mutex_lock(&classLocks[sizeClass]);
+
+	drain_remote_frees(sizeClass);
+
+	int nbTaken = 0;
+	while(threadCache.nbFree[sizeClass] < nbWanted)
+	{
+		Slab* slab = partialSlabs[sizeClass];
+		if(slab == NULL)
+		{
+			slab = add_slab(sizeClass);
+			if(slab == NULL)
+				break;
+		}
+
+		SmallBlock* newBlock = slab->firstFreeBlock;
+		slab->firstFreeBlock = newBlock->nextFree;
+		slab->nbUsed++;
+
+		// A full slab leaves the list of slabs with free blocks until one of its blocks is given back
+		if(slab->firstFreeBlock == NULL)
+		{
+			partialSlabs[sizeClass] = slab->nextPartial;
+			slab->nextPartial = NULL;
+		}
+
+		newBlock->nextFree = threadCache.firstFreeBlock[sizeClass];
+		threadCache.firstFreeBlock[sizeClass] = newBlock;
+		threadCache.nbFree[sizeClass]++;
+		nbTaken++;
+	}
+
+	pthread_mutex_unlock(&classLocks[sizeClass]);
+
+	classBlocksOut[sizeClass] += (uint64_t)nbTaken;
+	smallOutBytes += (uint64_t)nbTaken * small_class_size[sizeClass];
+	update_peak();
+
+	return threadCache.firstFreeBlock[sizeClass];
+}
+
+
+// Pushes a chain of free blocks of the same slab on its remoteFree list without any lock
+void push_remote_frees(Slab* slab, SmallBlock* firstBlock, SmallBlock* lastBlock)
+{
+	SmallBlock* oldFirst = atomic_load_explicit(&slab->remoteFree, memory_order_relaxed);
+	do
+	{
+		lastBlock->nextFree = oldFirst;
+	}
+	while(!atomic_compare_exchange_weak(&slab->remoteFree, &oldFirst, firstBlock));
+
+	// Only the thread that made the list non empty pushes the slab, so a slab is at most once in remoteSlabs
+	if(oldFirst == NULL)
+	{
+		Slab* oldSlab = atomic_load_explicit(&remoteSlabs[slab->sizeClass], memory_order_relaxed);
+		do
+		{
+			slab->nextRemote = oldSlab;
+		}
+		while(!atomic_compare_exchange_weak(&remoteSlabs[slab->sizeClass], &oldSlab, slab));
+	}
+}
+
+
+// Gives nbBlocks free blocks of a class from the cache of the current thread back to their slabs
+// Consecutive blocks of the same slab are pushed at once on its remoteFree list, so no lock is taken
+void flush_cache_blocks(int sizeClass, int nbBlocks)
+{
+	mark_latency_path(LATENCY_SLAB);
+	Slab* chainSlab = NULL;
+	SmallBlock* chainFirst = NULL;
+	SmallBlock* chainLast = NULL;
+	int nbFlushed = 0;
+
+	for(int i = 0; i < nbBlocks && threadCache.firstFreeBlock[sizeClass] != NULL; ++i)
+	{
+		nbFlushed++;
+		SmallBlock* freeBlock = threadCache.firstFreeBlock[sizeClass];
+		threadCache.firstFreeBlock[sizeClass] = freeBlock->nextFree;
+		threadCache.nbFree[sizeClass]--;
+
+		Slab* slab = slab_of(freeBlock);
+
+		if(slab != chainSlab)
+		{
+			if(chainSlab != NULL)
+				push_remote_frees(chainSlab, chainFirst, chainLast);
+			chainSlab = slab;
+			chainFirst = NULL;
+			chainLast = freeBlock;
+		}
+
+		// The block becomes the first block of the chain
+		freeBlock->nextFree = chainFirst;
+		chainFirst = freeBlock;
+	}
+
+	if(chainSlab != NULL)
+		push_remote_frees(chainSlab, chainFirst, chainLast);
+
+	classBlocksOut[sizeClass] -= (uint64_t)nbFlushed;
+	smallOutBytes -= (uint64_t)nbFlushed * small_class_size[sizeClass];
+}
+
+
+// Defined with the functions of the trace and of the latency histograms
+void release_trace_buffer();
+void release_latency_histograms();
+
+// Registers the cache of the current thread, to be flushed when the thread exits and read by myMallocStats
+void register_thread_cache()
+{
+	pthread_mutex_lock(&statsLock);
+	threadCache.prevCache = NULL;
+	threadCache.nextCache = threadCaches;
+	if(threadCaches != NULL)
+		threadCaches->prevCache = &threadCache;
+	threadCaches = &threadCache;
+	pthread_mutex_unlock(&statsLock);
+
+	pthread_setspecific(threadCacheKey, &threadCache);
+	threadCache.isRegistered = 1;
+}
+
+// Gives every block of the cache of the current thread back to the slabs, called when a thread exits
+void flush_thread_cache(void* cache)
+{
+	(void)cache;
+	for(int i = 0; i < NB_SMALL_CLASSES; ++i)
+	{
+		if(threadCache.nbFree[i] > 0)
+			flush_cache_blocks(i, threadCache.nbFree[i]);
+	}
+	release_trace_buffer();
+	release_latency_histograms();
+
+	// The counters of the thread are kept with those of the threads that exited, its cache may be registered again by a later destructor
+	pthread_mutex_lock(&statsLock);
+	for(int i = 0; i < NB_THREAD_STATS; ++i)
+	{
+		exitedStats[i] += threadCache.stats[i];
+		threadCache.stats[i] = 0;
+	}
+	if(threadCache.prevCache != NULL)
+		threadCache.prevCache->nextCache = threadCache.nextCache;
+	else
+		threadCaches = threadCache.nextCache;
+	if(threadCache.nextCache != NULL)
+		threadCache.nextCache->prevCache = threadCache.prevCache;
+	pthread_mutex_unlock(&statsLock);
+	threadCache.isRegistered = 0;
+}
+
+
+
+
+
+
+
+
+
+// Caches of the CPUs
+
+// Free small blocks can be kept by the CPUs instead of the threads, so that the memory cached grows with the number of CPUs and not of threads
+// With restartable sequences, the kernel starts a sequence again from its start when the thread is preempted, migrated or signaled before its
+// last store, so the lists of the CPU the thread runs on are changed with plain loads and stores. Otherwise sched_getcpu gives the cache and its lock protects it
+
+// Most caches used with restartable sequences, the sequences do not check the number of the CPU
+#define MAX_CPU_CACHES 1024
+
+// ThreadSanitizer does not see the order given by the restartable sequences, it checks the caches found with sched_getcpu instead
+#if defined(RSEQ_SIG) && !defined(__SANITIZE_THREAD__)
+#define CPU_CACHES_RSEQ
+#endif
+
+struct CpuCache_s
+{
+	// One chained list of free blocks per size class like in a thread cache, the first block of a list holds its length
+	// The lists are at the start of the cache, where the restartable sequences find them
+	_Alignas(64) SmallBlock* firstFreeBlock[NB_SMALL_CLASSES];
+	// Only taken when the cache is found with sched_getcpu
+	pthread_mutex_t lock;
+};
+
+typedef struct CpuCache_s CpuCache;
+
+// Caches used by small_malloc and small_free : PERCPU_OFF for the caches of the threads
+_Atomic int perCpuMode = PERCPU_OFF;
+// Caches of the CPUs and the way they are used, set by the first call to myPerCpuEnable
+// The mode never changes afterwards, as the same lists cannot be changed by restartable sequences and under a lock at the same time
+CpuCache* cpuCaches = NULL;
+int nbCpuCaches = 0;
+int cpuCachesMode = PERCPU_OFF;
+pthread_once_t cpuCachesOnce = PTHREAD_ONCE_INIT;
+
+
+#ifdef CPU_CACHES_RSEQ
+
+// Start of a restartable sequence in an asm statement, which runs from label 1 to label 2
+// Label 3 is its descriptor, given to the kernel in the rseq area of the thread, and label 4 is its abort handler, which starts it again from label 0
+// The sequence starts with the address of the cache of the CPU in rax
+#define RSEQ_SEQUENCE_START \
+	".pushsection __rseq_cs, \"aw\"\n\t" \
+	".balign 32\n\t" \
+	"3:\n\t" \
+	".long 0, 0\n\t" \
+	".quad 1f, 2f - 1f, 4f\n\t" \
+	".popsection\n\t" \
+	"0:\n\t" \
+	"leaq 3b(%%rip), %%rax\n\t" \
+	"movq %%rax, %[rseqCs]\n\t" \
+	"1:\n\t" \
+	"movl %[cpuId], %%eax\n\t" \
+	"imulq $%c[cacheSize], %%rax, %%rax\n\t" \
+	"addq %[caches], %%rax\n\t"
+
+// Abort handler of a restartable sequence, preceded by the signature registered by glibc inside an undefined instruction
+#define RSEQ_SEQUENCE_ABORT \
+	".pushsection __rseq_failure, \"ax\"\n\t" \
+	".byte 0x0f, 0xb9, 0x3d\n\t" \
+	".long %c[signature]\n\t" \
+	"4:\n\t" \
+	"jmp 0b\n\t" \
+	".popsection\n\t"
+
+#define RSEQ_SEQUENCE_OPERANDS(rseq) \
+	[rseqCs] "m"((rseq)->rseq_cs), [cpuId] "m"((rseq)->cpu_id), [caches] "r"(cpuCaches), [cacheSize] "i"(sizeof(CpuCache)), [signature] "i"(RSEQ_SIG)
+
+
+// Returns the rseq area of the current thread, where the kernel writes the CPU it runs on
+struct rseq* thread_rseq()
+{
+	return (struct rseq*)((char*)__builtin_thread_pointer() + __rseq_offset);
+}
+
+
+// Pops the first block of the list of a class of the cache of the CPU, or returns NULL if the list is empty
+SmallBlock* rseq_cpu_pop(int sizeClass)
+{
+	struct rseq* rseq = thread_rseq();
+	SmallBlock* block;
+	__asm__ __volatile__(
+		RSEQ_SEQUENCE_START
+		"leaq (%%rax, %[sizeClass], 8), %%rax\n\t"
+		"movq (%%rax), %[block]\n\t"
+		"testq %[block], %[block]\n\t"
+		"jz 2f\n\t"
+		"movq (%[block]), %%rcx\n\t"
+		// The store of the next block commits the sequence
+		"movq %%rcx, (%%rax)\n\t"
+		"2:\n\t"
+		RSEQ_SEQUENCE_ABORT
+		: [block] "=&r"(block)
+		: RSEQ_SEQUENCE_OPERANDS(rseq), [sizeClass] "r"((intptr_t)sizeClass)
+		: "rax", "rcx", "memory", "cc");
+	return block;
+}
+
+
+// Pushes a block on the list of a class of the cache of the CPU, unless the list already holds CACHE_MAX blocks
+// Returns the length of the list with the block, or 0 if the block was not pushed (its link may have been changed)
+size_t rseq_cpu_push(SmallBlock* block, int sizeClass)
+{
+	struct rseq* rseq = thread_rseq();
+	size_t length;
+	__asm__ __volatile__(
+		RSEQ_SEQUENCE_START
+		"leaq (%%rax, %[sizeClass], 8), %%rax\n\t"
+		"movq (%%rax), %%rcx\n\t"
+		"movq $1, %[length]\n\t"
+		"testq %%rcx, %%rcx\n\t"
+		"jz 5f\n\t"
+		"movq %c[lengthOffset](%%rcx), %[length]\n\t"
+		"cmpq $%c[maxLength], %[length]\n\t"
+		"jae 6f\n\t"
+		"incq %[length]\n\t"
+		"5:\n\t"
+		"movq %%rcx, (%[block])\n\t"
+		"movq %[length], %c[lengthOffset](%[block])\n\t"
+		// The store of the block commits the sequence
+		"movq %[block], (%%rax)\n\t"
+		"2:\n\t"
+		"jmp 7f\n\t"
+		"6:\n\t"
+		"xorl %k[length], %k[length]\n\t"
+		"7:\n\t"
+		RSEQ_SEQUENCE_ABORT
+		: [length] "=&r"(length)
+		: RSEQ_SEQUENCE_OPERANDS(rseq), [sizeClass] "r"((intptr_t)sizeClass), [block] "r"(block),
+		  [lengthOffset] "i"(offsetof(SmallBlock, listLength)), [maxLength] "i"(CACHE_MAX)
+		: "rax", "rcx", "memory", "cc");
+	return length;
+}
+
+
+// Takes the whole list of a class of the cache of the CPU, returns its first block
+SmallBlock* rseq_cpu_take(int sizeClass)
+{
+	struct rseq* rseq = thread_rseq();
+	SmallBlock* firstBlock;
+	__asm__ __volatile__(
+		RSEQ_SEQUENCE_START
+		"leaq (%%rax, %[sizeClass], 8), %%rax\n\t"
+		"movq (%%rax), %[firstBlock]\n\t"
+		// The store of the empty list commits the sequence
+		"movq $0, (%%rax)\n\t"
+		"2:\n\t"
+		RSEQ_SEQUENCE_ABORT
+		: [firstBlock] "=&r"(firstBlock)
+		: RSEQ_SEQUENCE_OPERANDS(rseq), [sizeClass] "r"((intptr_t)sizeClass)
+		: "rax", "memory", "cc");
+	return firstBlock;
+}
+
+#endif
+
+
+// Returns the cache of the CPU the thread runs on, locked, when the caches are found with sched_getcpu
+// The thread may have moved to another CPU since, which only makes it share the cache with the threads of that CPU
+CpuCache* lock_cpu_cache()
+{
+	int cpu = sched_getcpu();
+	CpuCache* cache = &cpuCaches[cpu > 0 ? cpu % nbCpuCaches : 0];
+	pthread_mutex_lock(&cache->lock);
+	return cache;
+}
+
+
+// Pops the first block of the list of a class of the cache of the CPU, or returns NULL if the list is empty
+SmallBlock* cpu_pop(int sizeClass)
+{
+#ifdef CPU_CACHES_RSEQ
+	if(cpuCachesMode == PERCPU_RSEQ)
+		return rseq_cpu_pop(sizeClass);
+#endif
+
+	CpuCache* cache = lock_cpu_cache();
+	SmallBlock* block = cache->firstFreeBlock[sizeClass];
+	if(block != NULL)
+		cache->firstFreeBlock[sizeClass] = block->nextFree;
+	pthread_mutex_unlock(&cache->lock);
+	return block;
+}
+
+
+// Pushes a block on the list of a class of the cache of the CPU, unless the list already holds CACHE_MAX blocks
+// Returns the length of the list with the block, or 0 if the block was not pushed (its link may have been changed)
+size_t cpu_push(SmallBlock* block, int sizeClass)
+{
+#ifdef CPU_CACHES_RSEQ
+	if(cpuCachesMode == PERCPU_RSEQ)
+		return rseq_cpu_push(block, sizeClass);
+#endif
+
+	CpuCache* cache = lock_cpu_cache();
+	SmallBlock* firstBlock = cache->firstFreeBlock[sizeClass];
+	size_t length = firstBlock != NULL ? firstBlock->listLength + 1 : 1;
+	if(length <= CACHE_MAX)
+	{
+		block->nextFree = firstBlock;
+		block->listLength = length;
+		cache->firstFreeBlock[sizeClass] = block;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return length <= CACHE_MAX ? length : 0;
+}
+
+
+// Takes the whole list of a class of the cache of the CPU, returns its first block
+SmallBlock* cpu_take(int sizeClass)
+{
+#ifdef CPU_CACHES_RSEQ
+	if(cpuCachesMode == PERCPU_RSEQ)
+		return rseq_cpu_take(sizeClass);
+#endif
+
+	CpuCache* cache = lock_cpu_cache();
+	SmallBlock* firstBlock = cache->firstFreeBlock[sizeClass];
+	cache->firstFreeBlock[sizeClass] = NULL;
+	pthread_mutex_unlock(&cache->lock);
+	return firstBlock;
+}
+
+
+// Moves the free blocks of a class from the cache of the current thread to the cache of its CPU
+// The blocks that the cache of the CPU cannot hold go back to the slabs, so the cache of the thread is left empty
+void give_to_cpu_cache(int sizeClass)
+{
+	SmallBlock* block = threadCache.firstFreeBlock[sizeClass];
+	while(block != NULL)
+	{
+		SmallBlock* nextBlock = block->nextFree;
+		if(cpu_push(block, sizeClass) == 0)
+		{
+			block->nextFree = nextBlock;
+			break;
+		}
+		threadCache.firstFreeBlock[sizeClass] = nextBlock;
+		threadCache.nbFree[sizeClass]--;
+		block = nextBlock;
+	}
+
+	if(threadCache.nbFree[sizeClass] > 0)
+		flush_cache_blocks(sizeClass, threadCache.nbFree[sizeClass]);
+}
+
+
+// Returns a small block of a class taken from the cache of the CPU the thread runs on, refilled from the slabs when it is empty
+void* cpu_malloc(int sizeClass)
+{
+	SmallBlock* newBlock = cpu_pop(sizeClass);
+
+	if(newBlock == NULL)
+	{
+		// A batch of blocks goes through the cache of the thread
+		newBlock = refill_thread_cache(sizeClass, CACHE_BATCH);
+		if(newBlock == NULL)
+		{
+			print_error("ERROR : no memory for small blocks available.\n");
+			return NULL;
+		}
+		threadCache.firstFreeBlock[sizeClass] = newBlock->nextFree;
+		threadCache.nbFree[sizeClass]--;
+		give_to_cpu_cache(sizeClass);
+	}
+
+	*small_class_state(newBlock, sizeClass) = BLOCK_IN_USE;
+	count_event(STAT_SMALL_ALLOCS + sizeClass);
+
+	return newBlock;
+}
+
+
+// Puts a free small block of a class in the cache of the CPU the thread runs on
+// When the list of the class is full, it is taken whole through the cache of the thread : a batch goes back to the slabs and the rest comes back with the block
+void cpu_free(SmallBlock* block, int sizeClass)
+{
+	if(cpu_push(block, sizeClass) != 0)
+	{
+		return;
+	}
+
+	SmallBlock* firstBlock = cpu_take(sizeClass);
+	block->nextFree = threadCache.firstFreeBlock[sizeClass];
+	threadCache.firstFreeBlock[sizeClass] = block;
+	threadCache.nbFree[sizeClass]++;
+	while(firstBlock != NULL)
+	{
+		SmallBlock* nextBlock = firstBlock->nextFree;
+		firstBlock->nextFree = threadCache.firstFreeBlock[sizeClass];
+		threadCache.firstFreeBlock[sizeClass] = firstBlock;
+		threadCache.nbFree[sizeClass]++;
+		firstBlock = nextBlock;
+	}
+
+	flush_cache_blocks(sizeClass, CACHE_BATCH);
+	give_to_cpu_cache(sizeClass);
+}
+
+
+// Maps the caches of the CPUs and chooses the way they are found, called only once through pthread_once
+void initialize_cpu_caches()
+{
+	long nbCpus = sysconf(_SC_NPROCESSORS_CONF);
+	nbCpuCaches = nbCpus > 0 && nbCpus <= MAX_CPU_CACHES ? (int)nbCpus : MAX_CPU_CACHES;
+
+	CpuCache* caches = mmap(NULL, (size_t)nbCpuCaches * sizeof(CpuCache), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	count_system_call(&nbMmapCalls);
+	if(caches == MAP_FAILED)
+	{
+		print_error("ERROR : no memory available for the caches of the CPUs.\n");
+		return;
+	}
+	for(int i = 0; i < nbCpuCaches; ++i)
+	{
+		pthread_mutex_init(&caches[i].lock, NULL);
+	}
+	cpuCaches = caches;
+	cpuCachesMode = PERCPU_GETCPU;
+
+#ifdef CPU_CACHES_RSEQ
+	// glibc registers the rseq area of every thread when it could register the one of the first thread, and sets __rseq_size
+	if(__rseq_size > 0 && nbCpus <= MAX_CPU_CACHES && thread_rseq()->cpu_id < (uint32_t)nbCpuCaches)
+		cpuCachesMode = PERCPU_RSEQ;
+#endif
+}
+
+
+// Keeps the free small blocks in a cache per CPU instead of a cache per thread, or per thread again when isEnabled is 0
+// The blocks kept by the caches of the CPUs stay there when they are disabled, until they are enabled again. Returns the caches now used
+int myPerCpuEnable(int isEnabled)
+{
+	if(!isInit)
+		pthread_once(&initOnce, initialize_memory);
+
+	if(!isEnabled)
+	{
+		perCpuMode = PERCPU_OFF;
+		return PERCPU_OFF;
+	}
+
+	pthread_once(&cpuCachesOnce, initialize_cpu_caches);
+	if(cpuCaches == NULL)
+	{
+		return PERCPU_OFF;
+	}
+
+	// The blocks kept by the calling thread go to the cache of its CPU, the other threads give theirs back to the slabs when they exit
+	for(int i = 0; i < NB_SMALL_CLASSES; ++i)
+	{
+		give_to_cpu_cache(i);
+	}
+	perCpuMode = cpuCachesMode;
+
+	return perCpuMode;
+}
+
+
+
+
+
+
+
+
+
+// Returns the address where the previous free block of the same bin is stored in a free large block
+LargeBlock** prev_free_large(LargeBlock* freeBlock)
+{
+	return (LargeBlock**)freeBlock->body;
+}
+
+
+// Returns the time in milliseconds of a clock that never goes back
+uint64_t current_time_ms()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+
+// Returns the address where the time when a free large block was last written is stored
+uint64_t* large_free_time(LargeBlock* freeBlock)
+{
+	return (uint64_t*)(freeBlock->body + sizeof(LargeBlock*));
+}
+
+
+// Computes the bin of a free large block of size bytes
+void large_bin_of(size_t size, int* fl, int* sl)
+{
+	*fl = 63 - __builtin_clzll(size);
+	*sl = (int)(size >> (*fl - LARGE_SL_LOG2)) & (LARGE_SL_COUNT - 1);
+}
+
+
+// Adds a free large block at the start of its bin and writes its footer
+void insert_large_free(LargeBlock* freeBlock)
+{
+	int fl, sl;
+	large_bin_of(freeBlock->size, &fl, &sl);
+
+	*(size_t*)((char*)freeBlock + freeBlock->size - sizeof(size_t)) = freeBlock->size;
+
+	LargeBlock* nextBlock = largeBins[fl][sl];
+	freeBlock->header = (size_t)nextBlock;
+	*prev_free_large(freeBlock) = NULL;
+	if(nextBlock != NULL)
+	{
+		*prev_free_large(nextBlock) = freeBlock;
+	}
+	largeBins[fl][sl] = freeBlock;
+
+	largeFlBitmap |= (uint64_t)1 << fl;
+	largeSlBitmap[fl] |= (uint32_t)1 << sl;
+	nbLargeFreeBlocks++;
+	largeFreeBytes += freeBlock->size;
+}
+
+
+// Removes a free large block from its bin
+void remove_large_free(LargeBlock* freeBlock)
+{
+	int fl, sl;
+	large_bin_of(freeBlock->size, &fl, &sl);
+	nbLargeFreeBlocks--;
+	largeFreeBytes -= freeBlock->size;
+
+	LargeBlock* nextBlock = (LargeBlock*)freeBlock->header;
+	LargeBlock* prevBlock = *prev_free_large(freeBlock);
+	if(nextBlock != NULL)
+	{
+		*prev_free_large(nextBlock) = prevBlock;
+	}
+	if(prevBlock != NULL)
+	{
+		prevBlock->header = (size_t)nextBlock;
+	}
+	else
+	{
+		largeBins[fl][sl] = nextBlock;
+		if(nextBlock == NULL)
+		{
+			largeSlBitmap[fl] &= ~((uint32_t)1 << sl);
+			if(largeSlBitmap[fl] == 0)
+				largeFlBitmap &= ~((uint64_t)1 << fl);
+		}
+	}
+}
+
+
+// Returns a free large block of at least size bytes without removing it from its bin, or NULL if there is none
+// Only the first block of the bin of size is checked, then the size is rounded up to the next bin so any block of the bin found is large enough
+LargeBlock* find_large_free(size_t size)
+{
+	int fl, sl;
+	large_bin_of(size, &fl, &sl);
+	if(largeBins[fl][sl] != NULL && largeBins[fl][sl]->size >= size)
+	{
+		return largeBins[fl][sl];
+	}
+
+	size_t roundedSize = size + ((size_t)1 << (fl - LARGE_SL_LOG2)) - 1;
+	large_bin_of(roundedSize, &fl, &sl);
+
+	// First a non empty bin in the same power of two, then the first non empty bin of a larger power of two
+	uint32_t slMap = largeSlBitmap[fl] & (~(uint32_t)0 << sl);
+	if(slMap == 0)
+	{
+		uint64_t flMap = fl + 1 < LARGE_FL_COUNT ? largeFlBitmap & (~(uint64_t)0 << (fl + 1)) : 0;
+		if(flMap == 0)
+		{
+			return NULL;
+		}
+		fl = __builtin_ctzll(flMap);
+		slMap = largeSlBitmap[fl];
+	}
+	sl = __builtin_ctz(slMap);
+
+	return largeBins[fl][sl];
+}
+
+
+// Moves the epilogue of the heap size bytes further, committing memory if needed
+// largeLock must be held, returns 0 if there is no memory left
+int extend_heap(size_t size)
+{
+	char* end = heap.end;
+	if(size > (size_t)(heap.commitEnd - end) && !commit_space(&heap, size - (size_t)(heap.commitEnd - end)))
+	{
+		return 0;
+	}
+	if(!commit_large_marks(end + size))
+	{
+		return 0;
+	}
+
+	heap.end = end + size;
+	LargeBlock* epilogue = (LargeBlock*)(heap.end - sizeof(LargeBlock));
+	epilogue->header = 1;
+	epilogue->size = 0;
+	if(heap.end > heapDirtyEnd)
+		heapDirtyEnd = heap.end;
+
+	return 1;
+}
+
+
+// Extends the heap and returns a new in-use large block of size bytes, or NULL if there is no memory left
+// The old epilogue becomes the start of the new block
+LargeBlock* grow_heap(size_t size)
+{
+	if(heap.end == NULL)
+	{
+		return NULL;
+	}
+
+	LargeBlock* newBlock = (LargeBlock*)(heap.end - sizeof(LargeBlock));
+	if(!extend_heap(size))
+	{
+		return NULL;
+	}
+	newBlock->header |= 1;
+	newBlock->size = size;
+
+	return newBlock;
+}
+
+
+// Returns the size of a large block with a body of size bytes, kept multiple of BODY_ALIGN so bodies stay aligned
+size_t large_block_size(size_t size)
+{
+	size_t blockSize = (size + 2*sizeof(size_t) + BODY_ALIGN - 1) / BODY_ALIGN * BODY_ALIGN;
+	return blockSize > LARGE_MIN_SIZE ? blockSize : LARGE_MIN_SIZE;
+}
+
+
+// Returns a pointer to the body of a large block of at least size bytes, largeLock must be held
+void* large_malloc(size_t size)
+{
+	mark_latency_path(LATENCY_LARGE);
+	// fullSizeMultSize is the size of a block with a body size of size
+	size_t fullSizeMultSize = large_block_size(size);
+
+	LargeBlock* currentLargeBlock = find_large_free(fullSizeMultSize);
+
+	// If no block large enough is found, memory is allocated on the heap, where the part never written holds only zeros
+	if(currentLargeBlock == NULL)
+	{
+		char* zeroStart = heapDirtyEnd;
+		currentLargeBlock = grow_heap(fullSizeMultSize);
+		if(currentLargeBlock == NULL)
+		{
+			print_error("ERROR : no memory available on the heap.\n");
+			return NULL;
+		}
+		largeZeroStart = zeroStart > currentLargeBlock->body ? zeroStart : currentLargeBlock->body;
+		largeZeroEnd = (char*)currentLargeBlock + currentLargeBlock->size;
+		set_large_mark(currentLargeBlock, 1);
+		return (void*)currentLargeBlock->body;
+	}
+
+	remove_large_free(currentLargeBlock);
+
+	// The pages purged from a clean free block hold only zeros
+	largeZeroStart = currentLargeBlock->body;
+	largeZeroEnd = currentLargeBlock->body;
+	if(*large_free_time(currentLargeBlock) == LARGE_CLEAN)
+	{
+		largeZeroStart = (char*)(((uintptr_t)(large_free_time(currentLargeBlock) + 1) + pageSize - 1) & ~(uintptr_t)(pageSize - 1));
+		largeZeroEnd = (char*)(((uintptr_t)currentLargeBlock + currentLargeBlock->size - sizeof(size_t)) & ~(uintptr_t)(pageSize - 1));
+	}
+
+	// If the block is too large, it is split into two parts to avoid fragmentation and the end goes back to the bins
+	if(currentLargeBlock->size >= fullSizeMultSize + SIZE_BLK_SMALL)
+	{
+		LargeBlock* newBlock = (LargeBlock*)((char*)currentLargeBlock + fullSizeMultSize);
+		newBlock->size = currentLargeBlock->size - fullSizeMultSize;
+		*large_free_time(newBlock) = *large_free_time(currentLargeBlock);
+		insert_large_free(newBlock);
+		currentLargeBlock->size = fullSizeMultSize;
+	}
+	else
+	{
+		LargeBlock* nextBlock = (LargeBlock*)((char*)currentLargeBlock + currentLargeBlock->size);
+		nextBlock->header &= ~(size_t)LARGE_PREV_FREE;
+	}
+
+	// A free block is never next to another free block, so the previous block is in use
+	currentLargeBlock->header = 1;
+	if(largeZeroEnd > (char*)currentLargeBlock + currentLargeBlock->size)
+		largeZeroEnd = (char*)currentLargeBlock + currentLargeBlock->size;
+	set_large_mark(currentLargeBlock, 1);
+	return (void*)currentLargeBlock->body;
+}
+
+
+// Adds a large block to the bins, merging it with the previous and the next blocks in memory if they are free
+// largeLock must be held
+void large_free(LargeBlock* freeBlock)
+{
+	mark_latency_path(LATENCY_LARGE);
+	// The parts of blocks split by the allocator are freed without having been marked, which leaves their bit cleared
+	set_large_mark(freeBlock, 0);
+
+	// The heap ends with an in-use epilogue, so the next block always exists
+	LargeBlock* nextBlock = (LargeBlock*)((char*)freeBlock + freeBlock->size);
+	if(!(nextBlock->header & 1))
+	{
+		remove_large_free(nextBlock);
+		freeBlock->size += nextBlock->size;
+	}
+
+	// The footer of the previous block gives its size
+	if(freeBlock->header & LARGE_PREV_FREE)
+	{
+		LargeBlock* prevBlock = (LargeBlock*)((char*)freeBlock - *((size_t*)freeBlock - 1));
+		remove_large_free(prevBlock);
+		prevBlock->size += freeBlock->size;
+		freeBlock = prevBlock;
+	}
+
+	*large_free_time(freeBlock) = purgeDelay >= 0 ? current_time_ms() : LARGE_DIRTY;
+	insert_large_free(freeBlock);
+
+	nextBlock = (LargeBlock*)((char*)freeBlock + freeBlock->size);
+	nextBlock->header |= LARGE_PREV_FREE;
+}
+
+
+// Returns a pointer to the body of a large block of at least size bytes aligned on alignment bytes, largeLock must be held
+// A block larger than needed is taken, then the padding before the aligned body and what is left after it go back to the bins
+void* large_aligned_malloc(size_t alignment, size_t size)
+{
+	mark_latency_path(LATENCY_LARGE);
+	size_t fullSize = large_block_size(size);
+
+	// The padding is either empty or large enough to be a free block
+	char* body = large_malloc(fullSize - 2*sizeof(size_t) + alignment + SIZE_SMALL_MAX);
+	if(body == NULL)
+	{
+		return NULL;
+	}
+
+	LargeBlock* block = (LargeBlock*)(body - 2*sizeof(size_t));
+	char* alignedBody = (char*)(((uintptr_t)body + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	if(alignedBody != body)
+	{
+		if((size_t)(alignedBody - body) < SIZE_SMALL_MAX)
+			alignedBody = (char*)(((uintptr_t)body + SIZE_SMALL_MAX + alignment - 1) & ~(uintptr_t)(alignment - 1));
+
+		// The padding keeps the header of the block, with its LARGE_PREV_FREE bit
+		LargeBlock* alignedBlock = (LargeBlock*)(alignedBody - 2*sizeof(size_t));
+		alignedBlock->header = 1;
+		alignedBlock->size = block->size - (size_t)((char*)alignedBlock - (char*)block);
+		block->size = (size_t)((char*)alignedBlock - (char*)block);
+		large_free(block);
+		block = alignedBlock;
+	}
+
+	if(block->size >= fullSize + SIZE_SMALL_MAX)
+	{
+		LargeBlock* restBlock = (LargeBlock*)((char*)block + fullSize);
+		restBlock->header = 1;
+		restBlock->size = block->size - fullSize;
+		block->size = fullSize;
+		large_free(restBlock);
+	}
+
+	// Freeing the padding has unmarked the block taken by large_malloc
+	set_large_mark(block, 1);
+	return (void*)block->body;
+}
+
+
+// Grows an in-use large block in place to maxSize bytes, or at least minSize bytes (block sizes, larger than the current size)
+// It takes the free block that follows it, and moves the end of the heap when it is the last block
+// largeLock must be held, returns 0 if the block cannot reach minSize bytes without moving (the block is then unchanged)
+int large_try_expand(LargeBlock* block, size_t minSize, size_t maxSize)
+{
+	mark_latency_path(LATENCY_LARGE);
+	LargeBlock* nextBlock = (LargeBlock*)((char*)block + block->size);
+	size_t availableSize = block->size;
+	uint64_t freeTime = LARGE_DIRTY;
+	if(!(nextBlock->header & 1))
+	{
+		availableSize += nextBlock->size;
+		freeTime = *large_free_time(nextBlock);
+	}
+
+	// The epilogue is the only block of size 0
+	int isLast = ((LargeBlock*)((char*)block + availableSize))->size == 0;
+	if(isLast && maxSize > availableSize && extend_heap(maxSize - availableSize))
+	{
+		availableSize = maxSize;
+	}
+	else if(isLast && minSize > availableSize && extend_heap(minSize - availableSize))
+	{
+		availableSize = minSize;
+	}
+	if(availableSize < minSize)
+	{
+		return 0;
+	}
+
+	if(!(nextBlock->header & 1))
+	{
+		remove_large_free(nextBlock);
+	}
+
+	// What is left after maxSize goes back to the bins if it is large enough, as when large_malloc splits a block
+	size_t newSize = maxSize < availableSize ? maxSize : availableSize;
+	LargeBlock* followingBlock = (LargeBlock*)((char*)block + availableSize);
+	if(availableSize - newSize >= SIZE_BLK_SMALL)
+	{
+		LargeBlock* restBlock = (LargeBlock*)((char*)block + newSize);
+		restBlock->size = availableSize - newSize;
+		*large_free_time(restBlock) = freeTime;
+		insert_large_free(restBlock);
+		followingBlock->header |= LARGE_PREV_FREE;
+	}
+	else
+	{
+		newSize = availableSize;
+		followingBlock->header &= ~(size_t)LARGE_PREV_FREE;
+	}
+	block->size = newSize;
+
+	return 1;
+}
+
+
+// Gives back to the OS the committed memory after the end of the heap, keeping pad bytes free at the top of the heap
+// If the last block of the heap is free, it is shrunk or removed first. largeLock must be held, returns 1 if memory was given back
+int trim_heap(size_t pad)
+{
+	LargeBlock* epilogue = (LargeBlock*)(heap.end - sizeof(LargeBlock));
+	if(epilogue->header & LARGE_PREV_FREE)
+	{
+		LargeBlock* topBlock = (LargeBlock*)((char*)epilogue - *((size_t*)epilogue - 1));
+
+		// A free block is never smaller than what large_malloc leaves when it splits a block
+		size_t keptSize = (pad + BODY_ALIGN - 1) / BODY_ALIGN * BODY_ALIGN;
+		if(keptSize != 0 && keptSize < SIZE_SMALL_MAX)
+			keptSize = SIZE_SMALL_MAX;
+
+		if(keptSize < topBlock->size)
+		{
+			remove_large_free(topBlock);
+			if(keptSize == 0)
+			{
+				// The block before a free block is in use
+				epilogue = topBlock;
+				epilogue->header = 1;
+			}
+			else
+			{
+				topBlock->size = keptSize;
+				insert_large_free(topBlock);
+				epilogue = (LargeBlock*)((char*)topBlock + keptSize);
+				epilogue->header = 1 | LARGE_PREV_FREE;
+			}
+			epilogue->size = 0;
+			heap.end = (char*)epilogue + sizeof(LargeBlock);
+		}
+	}
+
+	// Mapping the end of the reservation again gives its pages and the memory committed for them back to the OS
+	char* trimStart = (char*)(((uintptr_t)heap.end + pageSize - 1) & ~(uintptr_t)(pageSize - 1));
+	if(trimStart >= heap.commitEnd)
+	{
+		return 0;
+	}
+	count_system_call(&nbMmapCalls);
+	if(mmap(trimStart, (size_t)(heap.commitEnd - trimStart), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+	{
+		return 0;
+	}
+	heap.commitEnd = trimStart;
+	if(heapDirtyEnd > trimStart)
+		heapDirtyEnd = trimStart;
+
+	return 1;
+}
+
+
+// Gives back to the OS the whole pages inside the free large blocks last written before the time limit
+// The pages stay committed and are read as zeros the next time they are used. largeLock must be held, returns 1 if memory was given back
+int purge_large_blocks(uint64_t limit)
+{
+	int hasPurged = 0;
+
+	for(int fl = 0; fl < LARGE_FL_COUNT; ++fl)
+	{
+		for(int sl = 0; sl < LARGE_SL_COUNT && largeSlBitmap[fl] != 0; ++sl)
+		{
+			for(LargeBlock* freeBlock = largeBins[fl][sl]; freeBlock != NULL; freeBlock = (LargeBlock*)freeBlock->header)
+			{
+				uint64_t* freeTime = large_free_time(freeBlock);
+				if(*freeTime == LARGE_CLEAN || *freeTime > limit)
+				{
+					continue;
+				}
+
+				// The links of the block and its footer must stay
+				char* purgeStart = (char*)(((uintptr_t)(freeTime + 1) + pageSize - 1) & ~(uintptr_t)(pageSize - 1));
+				char* purgeEnd = (char*)(((uintptr_t)freeBlock + freeBlock->size - sizeof(size_t)) & ~(uintptr_t)(pageSize - 1));
+				if(purgeStart < purgeEnd)
+				{
+					// A block is clean only if its pages really are zeros, myCalloc relies on it
+					count_system_call(&nbMadviseCalls);
+					if(madvise(purgeStart, (size_t)(purgeEnd - purgeStart), MADV_DONTNEED) != 0)
+						continue;
+					hasPurged = 1;
+				}
+				*freeTime = LARGE_CLEAN;
+			}
+		}
+	}
+
+	return hasPurged;
+}
+
+
+// Purges the free large blocks unused for longer than purgeDelay, at most once every purgeDelay milliseconds
+// largeLock must be held
+void decay_large_blocks()
+{
+	uint64_t now = current_time_ms();
+	if(now < nextPurgeTime)
+	{
+		return;
+	}
+	nextPurgeTime = now + (uint64_t)purgeDelay;
+
+	LargeBlock* epilogue = (LargeBlock*)(heap.end - sizeof(LargeBlock));
+	if(epilogue->header & LARGE_PREV_FREE)
+	{
+		LargeBlock* topBlock = (LargeBlock*)((char*)epilogue - *((size_t*)epilogue - 1));
+		if(*large_free_time(topBlock) + (uint64_t)purgeDelay <= now)
+		{
+			trim_heap(0);
+		}
+	}
+	if(now >= (uint64_t)purgeDelay)
+		purge_large_blocks(now - (uint64_t)purgeDelay);
+}
+
+
+
+
+
+
+
+
+
+// Returns the size of the mapping needed for a huge block with a body of size bytes
+size_t huge_mapping_size(size_t size)
+{
+	size_t mappingSize = size + sizeof(HugeBlock);
+	return (mappingSize + pageSize - 1) / pageSize * pageSize;
+}
+
+
+// Returns the start of the mapping of a huge block, the page of its header
+// The header is at the start of the mapping unless the body was aligned by huge_aligned_malloc
+char* huge_mapping_start(HugeBlock* hugeBlock)
+{
+	return (char*)((uintptr_t)hugeBlock & ~(uintptr_t)(pageSize - 1));
+}
+
+
+// Returns the size in bytes of the mapping of a huge block
+size_t huge_block_mapping_size(HugeBlock* hugeBlock)
+{
+	return (size_t)((char*)hugeBlock - huge_mapping_start(hugeBlock)) + hugeBlock->size + 2*sizeof(HugeBlock*);
+}
+
+
+// Defined after huge_aligned_malloc, which shares it with huge_malloc
+void* add_huge(HugeBlock* hugeBlock, size_t mappingSize);
+
+// Maps a new huge block and returns a pointer to its body, or NULL if the OS has no memory left
+void* huge_malloc(size_t size)
+{
+	// The mapping size of a larger body does not fit in a size_t
+	if(size > SIZE_MAX - sizeof(HugeBlock) - pageSize)
+	{
+		print_error("ERROR : no memory available for a huge block.\n");
+		return NULL;
+	}
+
+	size_t mappingSize = huge_mapping_size(size);
+	HugeBlock* hugeBlock = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	count_system_call(&nbMmapCalls);
+	if(hugeBlock == MAP_FAILED)
+	{
+		print_error("ERROR : no memory available for a huge block.\n");
+		return NULL;
+	}
+
+	return add_huge(hugeBlock, mappingSize);
+}
+
+
+// Maps a new huge block whose body is aligned on alignment bytes and returns a pointer to its body, or NULL if the OS has no memory left
+// The mapping is larger by alignment bytes, then the pages before the header of the aligned body and after the body are given back
+void* huge_aligned_malloc(size_t alignment, size_t size)
+{
+	if(size > SIZE_MAX - sizeof(HugeBlock) - pageSize - alignment)
+	{
+		print_error("ERROR : no memory available for a huge block.\n");
+		return NULL;
+	}
+
+	size_t fullSize = huge_mapping_size(size + alignment);
+	char* fullMapping = mmap(NULL, fullSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	count_system_call(&nbMmapCalls);
+	if(fullMapping == MAP_FAILED)
+	{
+		print_error("ERROR : no memory available for a huge block.\n");
+		return NULL;
+	}
+
+	char* body = (char*)(((uintptr_t)fullMapping + sizeof(HugeBlock) + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	HugeBlock* hugeBlock = (HugeBlock*)(body - sizeof(HugeBlock));
+	char* start = huge_mapping_start(hugeBlock);
+	size_t mappingSize = huge_mapping_size(size + (size_t)((char*)hugeBlock - start));
+
+	if(start != fullMapping)
+	{
+		count_system_call(&nbMunmapCalls);
+		munmap(fullMapping, (size_t)(start - fullMapping));
+	}
+	if(start + mappingSize != fullMapping + fullSize)
+	{
+		count_system_call(&nbMunmapCalls);
+		munmap(start + mappingSize, (size_t)(fullMapping + fullSize - (start + mappingSize)));
+	}
+
+	return add_huge(hugeBlock, mappingSize);
+}
+
+
+// Adds a new huge block to the page map and to the list of huge blocks, its mapping of mappingSize bytes starts on the page of its header
+// Returns a pointer to its body, or NULL after giving the mapping back if the page map cannot hold it
+void* add_huge(HugeBlock* hugeBlock, size_t mappingSize)
+{
+	char* start = huge_mapping_start(hugeBlock);
+
+	pthread_mutex_lock(&hugeLock);
+	if(!map_page_leaves(start, mappingSize))
+	{
+		pthread_mutex_unlock(&hugeLock);
+		count_system_call(&nbMunmapCalls);
+		munmap(start, mappingSize);
+		print_error("ERROR : no memory available for a huge block.\n");
+		return NULL;
+	}
+	set_page_map(start, mappingSize, hugeBlock);
+
+	hugeBytes += mappingSize;
+	update_peak();
+	count_event(STAT_HUGE_ALLOCS);
+
+	hugeBlock->header = 1 | LARGE_HUGE;
+	hugeBlock->size = mappingSize - (size_t)((char*)hugeBlock - start) - 2*sizeof(HugeBlock*);
+
+	hugeBlock->prev = NULL;
+	hugeBlock->next = hugeBlocks;
+	if(hugeBlocks != NULL)
+		hugeBlocks->prev = hugeBlock;
+	hugeBlocks = hugeBlock;
+	pthread_mutex_unlock(&hugeLock);
+
+	return (void*)hugeBlock->body;
+}
+
+
+// Removes a huge block from the list of huge blocks, hugeLock must be held
+void unlink_huge(HugeBlock* hugeBlock)
+{
+	if(hugeBlock->prev != NULL)
+		hugeBlock->prev->next = hugeBlock->next;
+	else
+		hugeBlocks = hugeBlock->next;
+	if(hugeBlock->next != NULL)
+		hugeBlock->next->prev = hugeBlock->prev;
+}
+
+
+// Gives the mapping of a huge block back to the OS
+void huge_free(HugeBlock* hugeBlock)
+{
+	// The pages leave the page map before the system can give them to another huge block
+	char* start = huge_mapping_start(hugeBlock);
+	size_t mappingSize = huge_block_mapping_size(hugeBlock);
+	pthread_mutex_lock(&hugeLock);
+	unlink_huge(hugeBlock);
+	set_page_map(start, mappingSize, NULL);
+	pthread_mutex_unlock(&hugeLock);
+
+	hugeBytes -= mappingSize;
+	count_event(STAT_HUGE_FREES);
+	count_system_call(&nbMunmapCalls);
+	munmap(start, mappingSize);
+}
+
+
+// Resizes the mapping of a huge block with mremap, the kernel moves the pages instead of copying them if needed
+// Returns a pointer to the body of the block, or NULL if the OS has no memory left (the block is then unchanged)
+void* huge_realloc(HugeBlock* hugeBlock, size_t size)
+{
+	// The header of a block aligned by huge_aligned_malloc keeps its place in its first page
+	char* start = huge_mapping_start(hugeBlock);
+	size_t headerOffset = (size_t)((char*)hugeBlock - start);
+	if(size > SIZE_MAX - sizeof(HugeBlock) - pageSize - headerOffset)
+	{
+		print_error("ERROR : no memory available for a huge block.\n");
+		return NULL;
+	}
+
+	size_t oldMappingSize = huge_block_mapping_size(hugeBlock);
+	size_t mappingSize = huge_mapping_size(size + headerOffset);
+	if(mappingSize == oldMappingSize)
+	{
+		return (void*)hugeBlock->body;
+	}
+
+	// The block is taken out of the list while it may move
+	pthread_mutex_lock(&hugeLock);
+	unlink_huge(hugeBlock);
+
+	char* newStart = mremap(start, oldMappingSize, mappingSize, MREMAP_MAYMOVE);
+	count_system_call(&nbMremapCalls);
+	int hasFailed = newStart == MAP_FAILED;
+
+	// A grown mapping that the page map cannot hold is brought back to its old size and place
+	if(!hasFailed && !map_page_leaves(newStart, mappingSize))
+	{
+		count_system_call(&nbMremapCalls);
+		if(newStart == start)
+			mremap(newStart, mappingSize, oldMappingSize, 0);
+		else
+			mremap(newStart, mappingSize, oldMappingSize, MREMAP_MAYMOVE | MREMAP_FIXED, start);
+		hasFailed = 1;
+	}
+
+	HugeBlock* newBlock = hugeBlock;
+	if(!hasFailed)
+	{
+		newBlock = (HugeBlock*)(newStart + headerOffset);
+		set_page_map(start, oldMappingSize, NULL);
+		set_page_map(newStart, mappingSize, newBlock);
+		newBlock->size = mappingSize - headerOffset - 2*sizeof(HugeBlock*);
+		hugeBytes += mappingSize - oldMappingSize;
+		update_peak();
+	}
+
+	newBlock->prev = NULL;
+	newBlock->next = hugeBlocks;
+	if(hugeBlocks != NULL)
+		hugeBlocks->prev = newBlock;
+	hugeBlocks = newBlock;
+	pthread_mutex_unlock(&hugeLock);
+
+	if(hasFailed)
+	{
+		print_error("ERROR : no memory available for a huge block.\n");
+		return NULL;
+	}
+	return (void*)newBlock->body;
+}
+
+
+// Gives the free memory of the heap back to the OS, keeping pad bytes free at the top of the heap
+// Returns 1 if memory was given back and else 0
+int myTrim(size_t pad)
+{
+	if(!isInit)
+		return 0;
+
+	pthread_mutex_lock(&largeLock);
+	int hasTrimmed = trim_heap(pad);
+	hasTrimmed |= purge_large_blocks(UINT64_MAX);
+	pthread_mutex_unlock(&largeLock);
+
+	return hasTrimmed;
+}
+
+
+// Sets the delay after which free large blocks give their pages back to the OS, a negative delay disables it
+void mySetPurgeDelay(long milliseconds)
+{
+	pthread_mutex_lock(&largeLock);
+	purgeDelay = milliseconds;
+	nextPurgeTime = 0;
+	pthread_mutex_unlock(&largeLock);
+}
+
+
+// Grows the mapping of a huge block without moving it, to the mapping size of maxSize bytes or at least of minSize bytes
+// Returns 0 if the pages after the mapping are not free (the block is then unchanged)
+int huge_try_expand(HugeBlock* hugeBlock, size_t minSize, size_t maxSize)
+{
+	char* start = huge_mapping_start(hugeBlock);
+	size_t headerOffset = (size_t)((char*)hugeBlock - start);
+	size_t oldMappingSize = huge_block_mapping_size(hugeBlock);
+	size_t mappingSize = huge_mapping_size(maxSize + headerOffset);
+
+	pthread_mutex_lock(&hugeLock);
+	if(!map_page_leaves(start, mappingSize))
+	{
+		pthread_mutex_unlock(&hugeLock);
+		return 0;
+	}
+	count_system_call(&nbMremapCalls);
+	if(mremap(start, oldMappingSize, mappingSize, 0) == MAP_FAILED)
+	{
+		mappingSize = huge_mapping_size(minSize + headerOffset);
+		count_system_call(&nbMremapCalls);
+		if(mremap(start, oldMappingSize, mappingSize, 0) == MAP_FAILED)
+		{
+			mappingSize = oldMappingSize;
+		}
+	}
+	if(mappingSize != oldMappingSize)
+		set_page_map(start + oldMappingSize, mappingSize - oldMappingSize, hugeBlock);
+	hugeBlock->size = mappingSize - headerOffset - 2*sizeof(HugeBlock*);
+	hugeBytes += mappingSize - oldMappingSize;
+	update_peak();
+	pthread_mutex_unlock(&hugeLock);
+
+	return mappingSize != oldMappingSize;
+}
+
+
+// Sets the size from which blocks get their own mapping instead of being carved from the heap
+void mySetHugeThreshold(size_t size)
+{
+	hugeThreshold = size > SIZE_BLK_SMALL ? size : SIZE_BLK_SMALL + 1;
+}
+
+
+
+
+
+
+
+
+
+// Recording of the calls into a trace file
+
+// Calls of each thread kept in memory before being written to the trace file
+struct TraceBuffer_s
+{
+	// 1 while the owner thread or myTraceStop uses the buffer
+	_Atomic int isBusy;
+	// 1 while a thread uses the buffer, it is given to a new thread once its owner exits
+	int isOwned;
+	int nbRecords;
+	struct TraceBuffer_s* nextBuffer;
+	TraceRecord records[TRACE_BUFFER_RECORDS];
+};
+
+typedef struct TraceBuffer_s TraceBuffer;
+
+// File of the trace (-1 when no trace is recorded) and time in nanoseconds of the start of the trace
+_Atomic int traceFd = -1;
+uint64_t traceStartTime = 0;
+// Every buffer ever mapped, protected by traceLock
+pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+TraceBuffer* traceBuffers = NULL;
+pthread_once_t traceForkOnce = PTHREAD_ONCE_INIT;
+
+// Buffer of the thread, and 1 while the thread is inside a traced call, so that the calls it makes to the other functions are not recorded
+_Thread_local TraceBuffer* threadTraceBuffer __attribute__((tls_model("initial-exec"))) = NULL;
+_Thread_local int isInTracedCall __attribute__((tls_model("initial-exec"))) = 0;
+
+
+// Returns the time in nanoseconds of a clock that never goes back
+uint64_t current_time_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+
+// Writes the records of a buffer to the trace file and empties it, the buffer must be busy
+void flush_trace_buffer(TraceBuffer* buffer, int fd)
+{
+	char* data = (char*)buffer->records;
+	size_t size = (size_t)buffer->nbRecords * sizeof(TraceRecord);
+	while(size > 0)
+	{
+		ssize_t written = write(fd, data, size);
+		if(written <= 0)
+		{
+			print_error("ERROR : the trace file cannot be written.\n");
+			break;
+		}
+		data += written;
+		size -= (size_t)written;
+	}
+	buffer->nbRecords = 0;
+}
+
+
+// Returns the buffer of the current thread, reusing the buffer of an exited thread when there is one, NULL if no memory is left
+TraceBuffer* thread_trace_buffer()
+{
+	if(threadTraceBuffer != NULL)
+		return threadTraceBuffer;
+
+	pthread_mutex_lock(&traceLock);
+	TraceBuffer* buffer = traceBuffers;
+	while(buffer != NULL && buffer->isOwned)
+	{
+		buffer = buffer->nextBuffer;
+	}
+	if(buffer == NULL)
+	{
+		buffer = mmap(NULL, sizeof(TraceBuffer), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		nbMmapCalls++;
+		if(buffer == MAP_FAILED)
+		{
+			pthread_mutex_unlock(&traceLock);
+			return NULL;
+		}
+		buffer->nextBuffer = traceBuffers;
+		traceBuffers = buffer;
+	}
+	buffer->isOwned = 1;
+	pthread_mutex_unlock(&traceLock);
+
+	// The buffer is flushed when the thread exits, with the cache of the thread
+	if(!threadCache.isRegistered)
+		register_thread_cache();
+	threadTraceBuffer = buffer;
+	return buffer;
+}
+
+
+// Writes the records of the current thread to the trace file and gives its buffer to the next new thread, called when a thread exits
+void release_trace_buffer()
+{
+	TraceBuffer* buffer = threadTraceBuffer;
+	if(buffer == NULL)
+		return;
+
+	while(atomic_exchange_explicit(&buffer->isBusy, 1, memory_order_acquire))
+	{
+		sched_yield();
+	}
+	int fd = traceFd;
+	if(fd >= 0 && buffer->nbRecords > 0)
+		flush_trace_buffer(buffer, fd);
+	buffer->nbRecords = 0;
+	atomic_store_explicit(&buffer->isBusy, 0, memory_order_release);
+
+	pthread_mutex_lock(&traceLock);
+	buffer->isOwned = 0;
+	pthread_mutex_unlock(&traceLock);
+	threadTraceBuffer = NULL;
+}
+
+
+// Adds a call to the buffer of the current thread, startTime is the time of the call and ptr the block returned or freed
+void trace_record(uint64_t startTime, int operation, size_t size, void* ptr, uint64_t argument)
+{
+	TraceBuffer* buffer = thread_trace_buffer();
+	if(buffer == NULL)
+		return;
+
+	// Only myTraceStop can make the buffer busy at the same time, so the thread waits only while the trace stops
+	while(atomic_exchange_explicit(&buffer->isBusy, 1, memory_order_acquire))
+	{
+		sched_yield();
+	}
+	int fd = traceFd;
+	if(fd >= 0)
+	{
+		TraceRecord* record = &buffer->records[buffer->nbRecords++];
+		record->time = startTime - traceStartTime;
+		record->sizeOperation = (uint64_t)size << TRACE_OPERATION_BITS | (uint64_t)operation;
+		record->ptr = (uint64_t)(uintptr_t)ptr;
+		record->argument = argument;
+		if(buffer->nbRecords == TRACE_BUFFER_RECORDS)
+			flush_trace_buffer(buffer, fd);
+	}
+	atomic_store_explicit(&buffer->isBusy, 0, memory_order_release);
+}
+
+
+// A child process does not record the calls of its parent : it drops the records not yet written and stops its copy of the trace
+void trace_after_fork()
+{
+	int fd = traceFd;
+	traceFd = -1;
+	if(fd >= 0)
+		close(fd);
+
+	for(TraceBuffer* buffer = traceBuffers; buffer != NULL; buffer = buffer->nextBuffer)
+	{
+		buffer->nbRecords = 0;
+		buffer->isBusy = 0;
+		buffer->isOwned = buffer == threadTraceBuffer;
+	}
+	pthread_mutex_init(&traceLock, NULL);
+}
+
+
+void register_trace_fork()
+{
+	pthread_atfork(NULL, NULL, trace_after_fork);
+}
+
+
+// Starts recording every call to myMalloc, myAlignedAlloc, myCalloc, myFree and myRealloc into the file at path
+// Returns 1 if the trace has started, 0 if a trace is already recorded or the file cannot be created
+int myTraceStart(const char* path)
+{
+	if(traceFd >= 0)
+	{
+		print_error("ERROR : a trace is already recorded.\n");
+		return 0;
+	}
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0)
+	{
+		print_error("ERROR : the trace file cannot be created.\n");
+		return 0;
+	}
+
+	TraceHeader header;
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_VERSION;
+	header.recordSize = sizeof(TraceRecord);
+	if(write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header))
+	{
+		print_error("ERROR : the trace file cannot be written.\n");
+		close(fd);
+		return 0;
+	}
+
+	pthread_once(&traceForkOnce, register_trace_fork);
+	traceStartTime = current_time_ns();
+	traceFd = fd;
+	return 1;
+}
+
+
+// Stops the trace, writing the records of every thread to the trace file
+void myTraceStop()
+{
+	int fd = atomic_exchange(&traceFd, -1);
+	if(fd < 0)
+		return;
+
+	// A thread that saw the trace running before it stopped adds its record before the buffer is written
+	pthread_mutex_lock(&traceLock);
+	for(TraceBuffer* buffer = traceBuffers; buffer != NULL; buffer = buffer->nextBuffer)
+	{
+		while(atomic_exchange_explicit(&buffer->isBusy, 1, memory_order_acquire))
+		{
+			sched_yield();
+		}
+		if(buffer->nbRecords > 0)
+			flush_trace_buffer(buffer, fd);
+		atomic_store_explicit(&buffer->isBusy, 0, memory_order_release);
+	}
+	pthread_mutex_unlock(&traceLock);
+
+	close(fd);
+}
+
+
+// Traced versions of the functions, each calls the function itself and records the call
+// Allocations are recorded with the time after the call and frees with the time before it, so that a block is freed before its address is given again
+
+void* traced_malloc(size_t size)
+{
+	isInTracedCall = 1;
+	void* ptr = myMalloc(size);
+	isInTracedCall = 0;
+	trace_record(current_time_ns(), TRACE_MALLOC, size, ptr, 0);
+	return ptr;
+}
+
+
+void* traced_aligned_alloc(size_t alignment, size_t size)
+{
+	isInTracedCall = 1;
+	void* ptr = myAlignedAlloc(alignment, size);
+	isInTracedCall = 0;
+	trace_record(current_time_ns(), TRACE_ALIGNED_ALLOC, size, ptr, alignment);
+	return ptr;
+}
+
+
+void* traced_calloc(size_t nbElements, size_t size)
+{
+	isInTracedCall = 1;
+	void* ptr = myCalloc(nbElements, size);
+	isInTracedCall = 0;
+	trace_record(current_time_ns(), TRACE_CALLOC, nbElements * size, ptr, 0);
+	return ptr;
+}
+
+
+void traced_free(void* ptr)
+{
+	uint64_t startTime = current_time_ns();
+	isInTracedCall = 1;
+	myFree(ptr);
+	isInTracedCall = 0;
+	trace_record(startTime, TRACE_FREE, 0, ptr, 0);
+}
+
+
+void* traced_realloc(void* ptr, size_t size)
+{
+	isInTracedCall = 1;
+	void* newPtr = myRealloc(ptr, size);
+	isInTracedCall = 0;
+	trace_record(current_time_ns(), TRACE_REALLOC, size, newPtr, (uint64_t)(uintptr_t)ptr);
+	return newPtr;
+}
+
+
+
+
+
+
+
+
+
+// Statistics
+
+// Segment and thread of the export of the statistics, protected by exportLock
+pthread_mutex_t exportLock = PTHREAD_MUTEX_INITIALIZER;
+MyStatsSegment* exportSegment = NULL;
+char exportName[256];
+long exportPeriod = 0;
+pthread_t exportThread;
+_Atomic int isExportStopped = 0;
+
+
+// Fills stats with the statistics of the allocator
+void myMallocStats(MyMallocStats* stats)
+{
+	memset(stats, 0, sizeof(MyMallocStats));
+	if(!isInit)
+		return;
+
+	uint64_t counters[NB_THREAD_STATS];
+	pthread_mutex_lock(&statsLock);
+	for(int i = 0; i < NB_THREAD_STATS; ++i)
+	{
+		counters[i] = exitedStats[i];
+	}
+	for(ThreadCache* cache = threadCaches; cache != NULL; cache = cache->nextCache)
+	{
+		for(int i = 0; i < NB_THREAD_STATS; ++i)
+		{
+			counters[i] += atomic_load_explicit(&cache->stats[i], memory_order_relaxed);
+		}
+	}
+	pthread_mutex_unlock(&statsLock);
+
+	// The blocks out of the slabs are either in use or kept by a thread cache
+	for(int i = 0; i < NB_SMALL_CLASSES; ++i)
+	{
+		MyClassStats* classStats = &stats->classes[i];
+		classStats->blockSize = small_class_size[i];
+		classStats->nbAllocs = counters[STAT_SMALL_ALLOCS + i];
+		classStats->nbFrees = counters[STAT_SMALL_FREES + i];
+		classStats->nbSlabs = classNbSlabs[i];
+
+		uint64_t nbOut = classBlocksOut[i];
+		uint64_t nbInUse = classStats->nbAllocs > classStats->nbFrees ? classStats->nbAllocs - classStats->nbFrees : 0;
+		classStats->nbCached = nbOut > nbInUse ? nbOut - nbInUse : 0;
+		classStats->nbFreeInSlabs = classStats->nbSlabs * (uint64_t)small_class_nb_blocks[i] - nbOut;
+		stats->bytesInUse += nbInUse * small_class_size[i];
+	}
+
+	stats->nbLargeAllocs = counters[STAT_LARGE_ALLOCS];
+	stats->nbLargeFrees = counters[STAT_LARGE_FREES];
+	stats->nbHugeAllocs = counters[STAT_HUGE_ALLOCS];
+	stats->nbHugeFrees = counters[STAT_HUGE_FREES];
+
+	pthread_mutex_lock(&largeLock);
+	stats->nbLargeFreeBlocks = nbLargeFreeBlocks;
+	stats->largeFreeBytes = largeFreeBytes;
+	stats->bytesInUse += largeInUseBytes;
+	stats->bytesMapped += (uint64_t)(heap.commitEnd - heap.start);
+	stats->bytesReserved += (uint64_t)(heap.reserveEnd - heap.start);
+	// The largest free block is in the last non empty bin
+	if(largeFlBitmap != 0)
+	{
+		int fl = 63 - __builtin_clzll(largeFlBitmap);
+		int sl = 31 - __builtin_clz(largeSlBitmap[fl]);
+		for(LargeBlock* freeBlock = largeBins[fl][sl]; freeBlock != NULL; freeBlock = (LargeBlock*)freeBlock->header)
+		{
+			if(freeBlock->size > stats->largestFreeBlock)
+				stats->largestFreeBlock = freeBlock->size;
+		}
+	}
+	pthread_mutex_unlock(&largeLock);
+	stats->fragmentation = stats->largeFreeBytes > 0 ? 1 - (double)stats->largestFreeBlock / (double)stats->largeFreeBytes : 0;
+
+	pthread_mutex_lock(&slabLock);
+	stats->bytesMapped += (uint64_t)(slabSpace.commitEnd - slabSpace.start);
+	stats->bytesReserved += (uint64_t)(slabSpace.reserveEnd - slabSpace.start);
+	pthread_mutex_unlock(&slabLock);
+
+	stats->hugeBytes = hugeBytes;
+	stats->bytesInUse += stats->hugeBytes;
+	stats->bytesMapped += stats->hugeBytes;
+	stats->peakBytesInUse = peakBytes;
+
+	stats->nbMmap = nbMmapCalls;
+	stats->nbMunmap = nbMunmapCalls;
+	stats->nbMremap = nbMremapCalls;
+	stats->nbMprotect = nbMprotectCalls;
+	stats->nbMadvise = nbMadviseCalls;
+}
+
+
+// Copies the statistics into the shared memory segment, sequence is odd while they are written
+void write_stats_segment(MyStatsSegment* segment)
+{
+	MyMallocStats stats;
+	myMallocStats(&stats);
+
+	uint64_t sequence = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+	atomic_store_explicit(&segment->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	segment->updateTime = current_time_ms();
+	memcpy(&segment->stats, &stats, sizeof(MyMallocStats));
+	atomic_store_explicit(&segment->sequence, sequence + 2, memory_order_release);
+}
+
+
+// Thread of the export, it writes the statistics every period until the export stops
+void* export_stats(void* arg)
+{
+	MyStatsSegment* segment = arg;
+	// myStatsExport has just written the statistics
+	uint64_t nextTime = current_time_ms() + (uint64_t)exportPeriod;
+
+	while(!isExportStopped)
+	{
+		uint64_t now = current_time_ms();
+		if(now >= nextTime)
+		{
+			write_stats_segment(segment);
+			nextTime = now + (uint64_t)exportPeriod;
+		}
+
+		// Short sleeps keep myStatsExportStop from waiting a whole period
+		struct timespec sleepTime = {0, 10 * 1000000};
+		nanosleep(&sleepTime, NULL);
+	}
+	return NULL;
+}
+
+
+// Creates the shared memory segment name and starts a thread that writes the statistics into it every periodMs milliseconds
+// Returns 0 if an export is already running or the segment cannot be created
+int myStatsExport(const char* name, long periodMs)
+{
+	if(!isInit)
+		pthread_once(&initOnce, initialize_memory);
+
+	pthread_mutex_lock(&exportLock);
+	if(exportSegment != NULL)
+	{
+		pthread_mutex_unlock(&exportLock);
+		print_error("ERROR : the statistics are already exported.\n");
+		return 0;
+	}
+
+	// The name of a segment starts with a slash
+	exportName[0] = '/';
+	strncpy(exportName + 1, name[0] == '/' ? name + 1 : name, sizeof(exportName) - 2);
+	exportName[sizeof(exportName) - 1] = '\0';
+
+	int fd = shm_open(exportName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	MyStatsSegment* segment = MAP_FAILED;
+	if(fd >= 0 && ftruncate(fd, sizeof(MyStatsSegment)) == 0)
+	{
+		segment = mmap(NULL, sizeof(MyStatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		nbMmapCalls++;
+	}
+	if(fd >= 0)
+		close(fd);
+	if(segment == MAP_FAILED)
+	{
+		if(fd >= 0)
+			shm_unlink(exportName);
+		pthread_mutex_unlock(&exportLock);
+		print_error("ERROR : the shared memory segment of the statistics cannot be created.\n");
+		return 0;
+	}
+
+	// The segment holds the statistics as soon as the function returns
+	write_stats_segment(segment);
+	exportPeriod = periodMs > 0 ? periodMs : 1;
+	isExportStopped = 0;
+	if(pthread_create(&exportThread, NULL, export_stats, segment) != 0)
+	{
+		munmap(segment, sizeof(MyStatsSegment));
+		shm_unlink(exportName);
+		pthread_mutex_unlock(&exportLock);
+		print_error("ERROR : the thread exporting the statistics cannot be created.\n");
+		return 0;
+	}
+	exportSegment = segment;
+	pthread_mutex_unlock(&exportLock);
+	return 1;
+}
+
+
+// Stops the thread of the export and removes the shared memory segment
+void myStatsExportStop()
+{
+	pthread_mutex_lock(&exportLock);
+	if(exportSegment != NULL)
+	{
+		isExportStopped = 1;
+		pthread_join(exportThread, NULL);
+		nbMunmapCalls++;
+		munmap(exportSegment, sizeof(MyStatsSegment));
+		shm_unlink(exportName);
+		exportSegment = NULL;
+	}
+	pthread_mutex_unlock(&exportLock);
+}
+
+
+
+
+
+
+
+
+
+// Sampling heap profiler
+
+// Frames kept for each sampled block, and number of chained lists of the table of sampled blocks
+#define SAMPLE_MAX_FRAMES 32
+#define SAMPLE_BUCKETS 4096
+// When sampling is disabled, each thread checks again whether it was enabled after this many bytes
+#define SAMPLE_CHECK_INTERVAL ((int64_t)1 << 20)
+
+// A sampled block still in use, with the stack of the call that allocated it
+struct Sample_s
+{
+	void* ptr;
+	size_t size;
+	int nbFrames;
+	void* frames[SAMPLE_MAX_FRAMES];
+	struct Sample_s* nextSample;
+};
+
+typedef struct Sample_s Sample;
+
+// Average number of bytes between two samples (0 when sampling is disabled)
+_Atomic size_t sampleRate = 0;
+// Table of the sampled blocks in use by address, and the free samples, protected by sampleLock (taken after largeLock when a large block is freed)
+pthread_mutex_t sampleLock = PTHREAD_MUTEX_INITIALIZER;
+Sample* sampleBuckets[SAMPLE_BUCKETS];
+Sample* freeSamples = NULL;
+size_t nbSamples = 0;
+
+// Bytes the thread allocates before its next sample, its random generator, 1 once it has drawn an interval and 1 while it samples a block
+_Thread_local int64_t bytesUntilSample __attribute__((tls_model("initial-exec"))) = 0;
+_Thread_local uint64_t sampleRandom __attribute__((tls_model("initial-exec"))) = 0;
+_Thread_local int hasSampleInterval __attribute__((tls_model("initial-exec"))) = 0;
+_Thread_local int isSampling __attribute__((tls_model("initial-exec"))) = 0;
+
+// File written by the thread that waits for the profile signal, and the pipe the signal handler writes into
+char profilePath[4096];
+int profilePipe[2] = {-1, -1};
+pthread_t profileThread;
+
+
+// Returns a random number of bytes before the next sample, of exponential distribution and mean rate
+// Sampling every rate bytes on average, at random, makes every byte equally likely to be sampled whatever the sizes of the blocks
+int64_t next_sample_interval(size_t rate)
+{
+	if(sampleRandom == 0)
+		sampleRandom = (uint64_t)(uintptr_t)&sampleRandom ^ 0x9E3779B97F4A7C15ull;
+	sampleRandom ^= sampleRandom >> 12;
+	sampleRandom ^= sampleRandom << 25;
+	sampleRandom ^= sampleRandom >> 27;
+
+	// u = bits / 2^53 is in (0, 1], ln(u) = (exponent - 53) * ln(2) + ln(mantissa) where the mantissa is in [1, 2)
+	// ln(mantissa) = 2 * atanh(t) with t = (mantissa - 1) / (mantissa + 1) in [0, 1/3), whose series converges fast
+	uint64_t bits = ((sampleRandom * 0x2545F4914F6CDD1Dull) >> 11) + 1;
+	int exponent = 63 - __builtin_clzll(bits);
+	double mantissa = (double)bits / (double)((uint64_t)1 << exponent);
+	double t = (mantissa - 1) / (mantissa + 1);
+	double t2 = t * t;
+	double logU = (exponent - 53) * 0.6931471805599453 + 2 * t * (1 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7))));
+
+	double interval = -logU * (double)rate;
+	if(interval > (double)((int64_t)1 << 62))
+		return (int64_t)1 << 62;
+	return (int64_t)interval + 1;
+}
+
+
+// Returns the chained list of the table of sampled blocks where ptr is
+Sample** sample_bucket(void* ptr)
+{
+	return &sampleBuckets[((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull >> 52];
+}
+
+
+// Records a sampled block with the stack of the current call, and marks its header
+void add_sample(void* ptr, size_t size)
+{
+	Sample sample;
+	sample.ptr = ptr;
+	sample.size = size;
+	// backtrace may allocate memory the first time it is called, which isSampling keeps from being sampled
+	sample.nbFrames = backtrace(sample.frames, SAMPLE_MAX_FRAMES);
+
+	pthread_mutex_lock(&sampleLock);
+	Sample* newSample = freeSamples;
+	if(newSample == NULL)
+	{
+		// The samples are taken from pages mapped for them, so that the profiler does not change the blocks it samples
+		size_t nbNewSamples = 65536 / sizeof(Sample);
+		Sample* newSamples = mmap(NULL, nbNewSamples * sizeof(Sample), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		nbMmapCalls++;
+		if(newSamples == MAP_FAILED)
+		{
+			pthread_mutex_unlock(&sampleLock);
+			return;
+		}
+		for(size_t i = 0; i < nbNewSamples; ++i)
+		{
+			newSamples[i].nextSample = freeSamples;
+			freeSamples = &newSamples[i];
+		}
+		newSample = freeSamples;
+	}
+	freeSamples = newSample->nextSample;
+
+	*newSample = sample;
+	Sample** bucket = sample_bucket(ptr);
+	newSample->nextSample = *bucket;
+	*bucket = newSample;
+	nbSamples++;
+	pthread_mutex_unlock(&sampleLock);
+
+	// Other threads change the LARGE_PREV_FREE bit of the header of an in-use large block while they hold largeLock
+	if(is_slab_address(ptr))
+	{
+		*small_block_state(ptr, NULL) |= BLOCK_SAMPLED;
+	}
+	else if(!is_heap_address(ptr))
+	{
+		*((size_t*)ptr - 2) |= BLOCK_SAMPLED;
+	}
+	else
+	{
+		pthread_mutex_lock(&largeLock);
+		*((size_t*)ptr - 2) |= BLOCK_SAMPLED;
+		pthread_mutex_unlock(&largeLock);
+	}
+}
+
+
+// Removes a sampled block from the table, or moves it to newPtr when it is not NULL (a huge block moved by myRealloc)
+void remove_sample(void* ptr, void* newPtr)
+{
+	pthread_mutex_lock(&sampleLock);
+	for(Sample** sample = sample_bucket(ptr); *sample != NULL; sample = &(*sample)->nextSample)
+	{
+		if((*sample)->ptr == ptr)
+		{
+			Sample* oldSample = *sample;
+			*sample = oldSample->nextSample;
+			if(newPtr != NULL)
+			{
+				Sample** bucket = sample_bucket(newPtr);
+				oldSample->ptr = newPtr;
+				oldSample->nextSample = *bucket;
+				*bucket = oldSample;
+			}
+			else
+			{
+				oldSample->nextSample = freeSamples;
+				freeSamples = oldSample;
+				nbSamples--;
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sampleLock);
+}
+
+
+// Called when the thread has allocated enough bytes to take its next sample
+// Returns 1 if the block of size bytes that the thread allocates must be sampled, and draws the bytes before the next sample
+int is_sample_due()
+{
+	// The blocks allocated while a block is sampled (by backtrace) are not sampled
+	if(isSampling)
+		return 0;
+
+	size_t rate = sampleRate;
+	if(rate == 0)
+	{
+		bytesUntilSample = SAMPLE_CHECK_INTERVAL;
+		hasSampleInterval = 0;
+		return 0;
+	}
+
+	// A thread that has just been created or has just seen sampling enabled starts with a random interval, not with a sample
+	int isDue = hasSampleInterval;
+	hasSampleInterval = 1;
+	bytesUntilSample = next_sample_interval(rate);
+	return isDue;
+}
+
+
+// Sampled versions of the allocation functions, each calls the function itself and records the block
+// The function called counts the bytes of the block a second time, which are given back
+
+void* sampled_malloc(size_t size)
+{
+	isSampling = 1;
+	void* ptr = myMalloc(size);
+	bytesUntilSample += (int64_t)size;
+	if(ptr != NULL)
+		add_sample(ptr, size);
+	isSampling = 0;
+	return ptr;
+}
+
+
+void* sampled_aligned_alloc(size_t alignment, size_t size)
+{
+	isSampling = 1;
+	void* ptr = myAlignedAlloc(alignment, size);
+	bytesUntilSample += (int64_t)size;
+	if(ptr != NULL)
+		add_sample(ptr, size);
+	isSampling = 0;
+	return ptr;
+}
+
+
+void* sampled_calloc(size_t nbElements, size_t size)
+{
+	isSampling = 1;
+	void* ptr = myCalloc(nbElements, size);
+	bytesUntilSample += (int64_t)(nbElements * size);
+	if(ptr != NULL)
+		add_sample(ptr, nbElements * size);
+	isSampling = 0;
+	return ptr;
+}
+
+
+// Sets the average number of bytes between two sampled blocks, 0 disables sampling (the default)
+void mySetSampleRate(size_t bytes)
+{
+	// The first call to backtrace loads the unwinder, which is better done now than while the first block is sampled
+	void* frame;
+	backtrace(&frame, 1);
+	sampleRate = bytes;
+}
+
+
+// Writes text to fd through a buffer of PROFILE_BUFFER bytes, flushing it when text is NULL
+#define PROFILE_BUFFER 4096
+
+void write_profile(int fd, char* buffer, size_t* length, const char* text)
+{
+	size_t textLength = text != NULL ? strlen(text) : 0;
+	if(text == NULL || *length + textLength > PROFILE_BUFFER)
+	{
+		size_t written = 0;
+		while(written < *length)
+		{
+			ssize_t result = write(fd, buffer + written, *length - written);
+			if(result <= 0)
+				break;
+			written += (size_t)result;
+		}
+		*length = 0;
+	}
+	memcpy(buffer + *length, text != NULL ? text : "", textLength);
+	*length += textLength;
+}
+
+
+// Writes the sampled blocks in use into the file at path, in the heap profile format read by pprof
+// Returns 1 if the profile has been written
+int myDumpProfile(const char* path)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0)
+	{
+		print_error("ERROR : the profile file cannot be created.\n");
+		return 0;
+	}
+
+	// The samples are copied so that the file is written without keeping other threads from sampling
+	pthread_mutex_lock(&sampleLock);
+	size_t nbCopied = nbSamples;
+	Sample* samples = nbCopied > 0 ? mmap(NULL, nbCopied * sizeof(Sample), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : NULL;
+	if(samples == MAP_FAILED)
+	{
+		pthread_mutex_unlock(&sampleLock);
+		close(fd);
+		print_error("ERROR : no memory available for the profile.\n");
+		return 0;
+	}
+	size_t nbTaken = 0;
+	size_t totalSize = 0;
+	for(int i = 0; i < SAMPLE_BUCKETS; ++i)
+	{
+		for(Sample* sample = sampleBuckets[i]; sample != NULL && nbTaken < nbCopied; sample = sample->nextSample)
+		{
+			samples[nbTaken++] = *sample;
+			totalSize += sample->size;
+		}
+	}
+	pthread_mutex_unlock(&sampleLock);
+
+	// pprof scales the sampled counts up with the sampling rate given in the header
+	char buffer[PROFILE_BUFFER];
+	size_t length = 0;
+	char line[128];
+	snprintf(line, sizeof(line), "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n", nbTaken, totalSize, nbTaken, totalSize, (size_t)sampleRate);
+	write_profile(fd, buffer, &length, line);
+	for(size_t i = 0; i < nbTaken; ++i)
+	{
+		snprintf(line, sizeof(line), "1: %zu [1: %zu] @", samples[i].size, samples[i].size);
+		write_profile(fd, buffer, &length, line);
+		// The first frames are those of the profiler itself
+		for(int j = 2; j < samples[i].nbFrames; ++j)
+		{
+			snprintf(line, sizeof(line), " %p", samples[i].frames[j]);
+			write_profile(fd, buffer, &length, line);
+		}
+		write_profile(fd, buffer, &length, "\n");
+	}
+	if(samples != NULL)
+		munmap(samples, nbCopied * sizeof(Sample));
+
+	// pprof finds the binaries of the addresses in the mappings of the process
+	write_profile(fd, buffer, &length, "\nMAPPED_LIBRARIES:\n");
+	write_profile(fd, buffer, &length, NULL);
+	int mapsFd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+	ssize_t nbRead;
+	while(mapsFd >= 0 && (nbRead = read(mapsFd, buffer, sizeof(buffer))) > 0)
+	{
+		length = (size_t)nbRead;
+		write_profile(fd, buffer, &length, NULL);
+	}
+	if(mapsFd >= 0)
+		close(mapsFd);
+
+	close(fd);
+	return 1;
+}
+
+
+// Signal handler of the profile, it only wakes up the thread that writes the profile
+void on_profile_signal(int signal)
+{
+	(void)signal;
+	// The interrupted code may read errno right after the signal
+	int savedErrno = errno;
+	char byte = 0;
+	ssize_t written = write(profilePipe[1], &byte, 1);
+	(void)written;
+	errno = savedErrno;
+}
+
+
+// Thread that writes the profile every time the signal is received
+void* wait_profile_signal(void* arg)
+{
+	(void)arg;
+	char byte;
+	while(read(profilePipe[0], &byte, 1) > 0)
+	{
+		myDumpProfile(profilePath);
+	}
+	return NULL;
+}
+
+
+// Writes the profile into the file at path every time the process receives signal, returns 1 if the handler is installed
+// The profile is written by a thread of its own, as the signal may interrupt a thread that holds the locks of the allocator
+int mySetProfileSignal(int signal, const char* path)
+{
+	if(profilePipe[0] >= 0)
+	{
+		print_error("ERROR : a signal already writes the profile.\n");
+		return 0;
+	}
+	strncpy(profilePath, path, sizeof(profilePath) - 1);
+
+	if(pipe(profilePipe) != 0)
+	{
+		print_error("ERROR : the pipe of the profile signal cannot be created.\n");
+		return 0;
+	}
+	if(pthread_create(&profileThread, NULL, wait_profile_signal, NULL) != 0)
+	{
+		close(profilePipe[0]);
+		close(profilePipe[1]);
+		profilePipe[0] = -1;
+		print_error("ERROR : the thread of the profile signal cannot be created.\n");
+		return 0;
+	}
+	pthread_detach(profileThread);
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_profile_signal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	return sigaction(signal, &action, NULL) == 0;
+}
+
+
+
+
+
+
+
+
+
+// Latency histograms
+
+// Histograms of the durations of the calls made by a thread
+struct LatencyHistograms_s
+{
+	// 1 while a thread uses the histograms, they are given to a new thread once their owner exits and keep its counts
+	int isOwned;
+	struct LatencyHistograms_s* nextHistograms;
+	_Atomic uint64_t counts[LATENCY_NB_CALLS][LATENCY_NB_PATHS][LATENCY_BUCKETS];
+};
+
+typedef struct LatencyHistograms_s LatencyHistograms;
+
+// 1 while the calls are measured, and nanoseconds per tick of latency_ticks
+_Atomic int isLatencyEnabled = 0;
+double latencyNsPerTick = 0;
+pthread_once_t latencyOnce = PTHREAD_ONCE_INIT;
+// Histograms of every thread, protected by latencyLock
+pthread_mutex_t latencyLock = PTHREAD_MUTEX_INITIALIZER;
+LatencyHistograms* latencyHistograms = NULL;
+
+// Histograms of the thread
+_Thread_local LatencyHistograms* threadLatencyHistograms __attribute__((tls_model("initial-exec"))) = NULL;
+
+
+// Returns the time stamp counter of the processor, read in a few cycles without any system call
+// Other processors use the clock in nanoseconds
+uint64_t latency_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return current_time_ns();
+#endif
+}
+
+
+// A child process keeps the histograms of its parent, but only the thread that called fork still uses its own
+void latency_after_fork()
+{
+	for(LatencyHistograms* histograms = latencyHistograms; histograms != NULL; histograms = histograms->nextHistograms)
+	{
+		histograms->isOwned = histograms == threadLatencyHistograms;
+	}
+	pthread_mutex_init(&latencyLock, NULL);
+}
+
+
+// Measures the nanoseconds per tick of latency_ticks against the clock, over 10 milliseconds
+void initialize_latency()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	uint64_t startTime = current_time_ns();
+	uint64_t startTicks = latency_ticks();
+	struct timespec delay = {0, 10000000};
+	nanosleep(&delay, NULL);
+	uint64_t ticks = latency_ticks() - startTicks;
+	uint64_t time = current_time_ns() - startTime;
+	latencyNsPerTick = ticks > 0 ? (double)time / (double)ticks : 1;
+#else
+	latencyNsPerTick = 1;
+#endif
+	pthread_atfork(NULL, NULL, latency_after_fork);
+}
+
+
+// Returns the histograms of the current thread, reusing those of an exited thread when there are some, NULL if no memory is left
+LatencyHistograms* thread_latency_histograms()
+{
+	if(threadLatencyHistograms != NULL)
+		return threadLatencyHistograms;
+
+	pthread_mutex_lock(&latencyLock);
+	LatencyHistograms* histograms = latencyHistograms;
+	while(histograms != NULL && histograms->isOwned)
+	{
+		histograms = histograms->nextHistograms;
+	}
+	if(histograms == NULL)
+	{
+		histograms = mmap(NULL, sizeof(LatencyHistograms), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		nbMmapCalls++;
+		if(histograms == MAP_FAILED)
+		{
+			pthread_mutex_unlock(&latencyLock);
+			return NULL;
+		}
+		histograms->nextHistograms = latencyHistograms;
+		latencyHistograms = histograms;
+	}
+	histograms->isOwned = 1;
+	pthread_mutex_unlock(&latencyLock);
+
+	// The histograms are released when the thread exits, with the cache of the thread
+	if(!threadCache.isRegistered)
+		register_thread_cache();
+	threadLatencyHistograms = histograms;
+	return histograms;
+}
+
+
+// Gives the histograms of the current thread to the next new thread, called when a thread exits
+void release_latency_histograms()
+{
+	if(threadLatencyHistograms == NULL)
+		return;
+
+	pthread_mutex_lock(&latencyLock);
+	threadLatencyHistograms->isOwned = 0;
+	pthread_mutex_unlock(&latencyLock);
+	threadLatencyHistograms = NULL;
+}
+
+
+// Counts a call that started at startTicks in the histogram of the slowest path it took
+void record_latency(int call, uint64_t startTicks)
+{
+	uint64_t ticks = latency_ticks() - startTicks;
+	int path = latencyPath;
+	LatencyHistograms* histograms = thread_latency_histograms();
+	if(histograms == NULL)
+		return;
+
+	uint64_t time = (uint64_t)((double)ticks * latencyNsPerTick);
+	int bucket = time < 2 ? 0 : 63 - __builtin_clzll(time);
+	if(bucket >= LATENCY_BUCKETS)
+		bucket = LATENCY_BUCKETS - 1;
+
+	// Only the thread writes its histograms, myLatencyStats reads them at any time
+	_Atomic uint64_t* count = &histograms->counts[call][path][bucket];
+	atomic_store_explicit(count, atomic_load_explicit(count, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+
+// Measured versions of the functions, each calls the function itself and counts its duration
+
+void* timed_malloc(size_t size)
+{
+	uint64_t startTicks = latency_ticks();
+	isInTimedCall = 1;
+	latencyPath = LATENCY_CACHE;
+	void* ptr = myMalloc(size);
+	isInTimedCall = 0;
+	record_latency(LATENCY_ALLOC, startTicks);
+	return ptr;
+}
+
+
+void* timed_aligned_alloc(size_t alignment, size_t size)
+{
+	uint64_t startTicks = latency_ticks();
+	isInTimedCall = 1;
+	latencyPath = LATENCY_CACHE;
+	void* ptr = myAlignedAlloc(alignment, size);
+	isInTimedCall = 0;
+	record_latency(LATENCY_ALLOC, startTicks);
+	return ptr;
+}
+
+
+void* timed_calloc(size_t nbElements, size_t size)
+{
+	uint64_t startTicks = latency_ticks();
+	isInTimedCall = 1;
+	latencyPath = LATENCY_CACHE;
+	void* ptr = myCalloc(nbElements, size);
+	isInTimedCall = 0;
+	record_latency(LATENCY_ALLOC, startTicks);
+	return ptr;
+}
+
+
+void timed_free(void* ptr)
+{
+	uint64_t startTicks = latency_ticks();
+	isInTimedCall = 1;
+	latencyPath = LATENCY_CACHE;
+	myFree(ptr);
+	isInTimedCall = 0;
+	record_latency(LATENCY_FREE, startTicks);
+}
+
+
+void* timed_realloc(void* ptr, size_t size)
+{
+	uint64_t startTicks = latency_ticks();
+	isInTimedCall = 1;
+	latencyPath = LATENCY_CACHE;
+	void* newPtr = myRealloc(ptr, size);
+	isInTimedCall = 0;
+	record_latency(LATENCY_REALLOC, startTicks);
+	return newPtr;
+}
+
+
+// Starts measuring the duration of every call, or stops it when isEnabled is 0
+void myLatencyEnable(int isEnabled)
+{
+	if(isEnabled)
+		pthread_once(&latencyOnce, initialize_latency);
+	isLatencyEnabled = isEnabled != 0;
+}
+
+
+// Fills stats with the histograms of every thread added up
+void myLatencyStats(MyLatencyStats* stats)
+{
+	memset(stats, 0, sizeof(MyLatencyStats));
+
+	pthread_mutex_lock(&latencyLock);
+	for(LatencyHistograms* histograms = latencyHistograms; histograms != NULL; histograms = histograms->nextHistograms)
+	{
+		for(int i = 0; i < LATENCY_NB_CALLS; ++i)
+		{
+			for(int j = 0; j < LATENCY_NB_PATHS; ++j)
+			{
+				for(int k = 0; k < LATENCY_BUCKETS; ++k)
+				{
+					stats->counts[i][j][k] += atomic_load_explicit(&histograms->counts[i][j][k], memory_order_relaxed);
+				}
+			}
+		}
+	}
+	pthread_mutex_unlock(&latencyLock);
+}
+
+
+// Returns the upper bound in nanoseconds of the bucket holding the call at fraction of the calls of a path sorted by duration
+// Every path is taken when path is negative, 0 is returned when there is no call
+uint64_t myLatencyPercentile(const MyLatencyStats* stats, int call, int path, double fraction)
+{
+	if(call < 0 || call >= LATENCY_NB_CALLS || path >= LATENCY_NB_PATHS)
+	{
+		print_error("ERROR : unknown call or path.\n");
+		return 0;
+	}
+
+	uint64_t counts[LATENCY_BUCKETS];
+	uint64_t total = 0;
+	for(int k = 0; k < LATENCY_BUCKETS; ++k)
+	{
+		counts[k] = 0;
+		for(int j = 0; j < LATENCY_NB_PATHS; ++j)
+		{
+			if(path < 0 || path == j)
+				counts[k] += stats->counts[call][j][k];
+		}
+		total += counts[k];
+	}
+	if(total == 0)
+		return 0;
+
+	double rank = fraction * (double)total;
+	uint64_t seen = 0;
+	int bucket = 0;
+	while(bucket < LATENCY_BUCKETS - 1 && (seen + counts[bucket] == 0 || (double)(seen + counts[bucket]) < rank))
+	{
+		seen += counts[bucket];
+		bucket++;
+	}
+	return (uint64_t)2 << bucket;
+}
+
+
+// Writes a table of the count, percentiles and maximum of each call and path into fd
+void myLatencyReport(int fd)
+{
+	static const char* callNames[LATENCY_NB_CALLS] = {"alloc", "free", "realloc"};
+	static const char* pathNames[LATENCY_NB_PATHS] = {"cache", "slab", "large", "copy", "system"};
+
+	MyLatencyStats stats;
+	myLatencyStats(&stats);
+
+	char buffer[PROFILE_BUFFER];
+	size_t length = 0;
+	char line[128];
+	snprintf(line, sizeof(line), "%-8s %-7s %12s %10s %10s %10s %10s\n", "call", "path", "calls", "p50 ns", "p99 ns", "p999 ns", "max ns");
+	write_profile(fd, buffer, &length, line);
+	for(int i = 0; i < LATENCY_NB_CALLS; ++i)
+	{
+		// Each call gets a line per path taken, then a line for all of them
+		for(int j = 0; j <= LATENCY_NB_PATHS; ++j)
+		{
+			int path = j < LATENCY_NB_PATHS ? j : -1;
+			uint64_t nbCalls = 0;
+			for(int k = 0; k < LATENCY_BUCKETS; ++k)
+			{
+				for(int l = 0; l < LATENCY_NB_PATHS; ++l)
+				{
+					if(path < 0 || path == l)
+						nbCalls += stats.counts[i][l][k];
+				}
+			}
+			if(nbCalls == 0)
+				continue;
+
+			snprintf(line, sizeof(line), "%-8s %-7s %12" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+				callNames[i], path < 0 ? "all" : pathNames[path], nbCalls, myLatencyPercentile(&stats, i, path, 0.5),
+				myLatencyPercentile(&stats, i, path, 0.99), myLatencyPercentile(&stats, i, path, 0.999), myLatencyPercentile(&stats, i, path, 1));
+			write_profile(fd, buffer, &length, line);
+		}
+	}
+	write_profile(fd, buffer, &length, NULL);
+}
+
+
+
+
+
+
+
+
+
+// Defined after myMalloc, which shares it with myAlignedAlloc
+void* small_malloc(int sizeClass);
+
+// Returns a pointer to the body of a memory block
+void* myMalloc(size_t size)
+{
+	if(traceFd >= 0 && !isInTracedCall)
+		return traced_malloc(size);
+
+	if(isLatencyEnabled && !isInTimedCall)
+		return timed_malloc(size);
+
+	if((bytesUntilSample -= (int64_t)size) < 0 && is_sample_due())
+		return sampled_malloc(size);
+
+	if(!isInit)
+		pthread_once(&initOnce, initialize_memory);
+
+	if(size >= hugeThreshold)
+	{
+		return huge_malloc(size);
+	}
+
+	if(size > SIZE_BLK_SMALL)
+	{
+		pthread_mutex_lock(&largeLock);
+		void* body = large_malloc(size);
+		if(body != NULL)
+			add_large_in_use((int64_t)*((size_t*)body - 1));
+		pthread_mutex_unlock(&largeLock);
+		if(body != NULL)
+			count_event(STAT_LARGE_ALLOCS);
+		return body;
+	}
+
+	// Now I deal with small blocks, taken from the cache of the thread without any lock
+
+	return small_malloc(small_class_lookup[(size + 7) / 8]);
+
+}
+
+
+// Returns a pointer to the body of a block of at least size bytes aligned on alignment bytes (a power of two)
+void* myAlignedAlloc(size_t alignment, size_t size)
+{
+	if(traceFd >= 0 && !isInTracedCall)
+		return traced_aligned_alloc(alignment, size);
+
+	if(isLatencyEnabled && !isInTimedCall)
+		return timed_aligned_alloc(alignment, size);
+
+	// Blocks aligned on at most BODY_ALIGN bytes are sampled by myMalloc
+	if(alignment > BODY_ALIGN && (bytesUntilSample -= (int64_t)size) < 0 && is_sample_due())
+		return sampled_aligned_alloc(alignment, size);
+
+	if(alignment == 0 || (alignment & (alignment - 1)) != 0)
+	{
+		print_error("ERROR : the alignment must be a power of two.\n");
+		return NULL;
+	}
+
+	if(alignment <= BODY_ALIGN)
+	{
+		return myMalloc(size);
+	}
+
+	if(!isInit)
+		pthread_once(&initOnce, initialize_memory);
+
+	// The smallest class large enough whose bodies are aligned enough
+	if(size <= SIZE_BLK_SMALL && alignment <= SMALL_ALIGN_MAX)
+	{
+		int sizeClass = small_class_lookup[(size + 7) / 8];
+		while(small_class_align[sizeClass] < alignment)
+		{
+			sizeClass++;
+		}
+		return small_malloc(sizeClass);
+	}
+
+	// A huge aligned block gets its own mapping, its header is just before the aligned body
+	if(size >= hugeThreshold)
+	{
+		return huge_aligned_malloc(alignment, size);
+	}
+
+	if(size > (size_t)(heap.reserveEnd - heap.start) || alignment > (size_t)(heap.reserveEnd - heap.start))
+	{
+		print_error("ERROR : no memory available on the heap.\n");
+		return NULL;
+	}
+
+	// Every other aligned block is a large block
+	pthread_mutex_lock(&largeLock);
+	void* body = large_aligned_malloc(alignment, size > SIZE_BLK_SMALL ? size : SIZE_BLK_SMALL + 1);
+	if(body != NULL)
+		add_large_in_use((int64_t)*((size_t*)body - 1));
+	pthread_mutex_unlock(&largeLock);
+	if(body != NULL)
+		count_event(STAT_LARGE_ALLOCS);
+	return body;
+}
+
+
+// Returns a pointer to the body of a small block of a size class, taken from the cache of the thread
+void* small_malloc(int sizeClass)
+{
+	if(perCpuMode != PERCPU_OFF)
+		return cpu_malloc(sizeClass);
+
+	SmallBlock* newBlock = threadCache.firstFreeBlock[sizeClass];
+
+	if(newBlock == NULL)
+	{
+		newBlock = refill_thread_cache(sizeClass, CACHE_BATCH);
+		if(newBlock == NULL)
+		{
+			print_error("ERROR : no memory for small blocks available.\n");
+			return NULL;
+		}
+	}
+
+	threadCache.firstFreeBlock[sizeClass] = newBlock->nextFree;
+	threadCache.nbFree[sizeClass]--;
+	*small_class_state(newBlock, sizeClass) = BLOCK_IN_USE;
+	count_event(STAT_SMALL_ALLOCS + sizeClass);
+
+	return newBlock;
+
+}
+
+
+
+// Returns a pointer to the body of a memory block of nbElements * size bytes set to zero
+// The memory known to be fresh from the OS (new heap, purged pages or huge blocks) is not written
+void* myCalloc(size_t nbElements, size_t size)
+{
+	if(traceFd >= 0 && !isInTracedCall)
+		return traced_calloc(nbElements, size);
+
+	if(isLatencyEnabled && !isInTimedCall)
+		return timed_calloc(nbElements, size);
+
+	if(size != 0 && nbElements > SIZE_MAX / size)
+	{
+		print_error("ERROR : the size of the array is too large.\n");
+		return NULL;
+	}
+	size_t totalSize = nbElements * size;
+
+	// Small blocks are sampled by myMalloc
+	if(totalSize > SIZE_BLK_SMALL && (bytesUntilSample -= (int64_t)totalSize) < 0 && is_sample_due())
+		return sampled_calloc(nbElements, size);
+
+	if(!isInit)
+		pthread_once(&initOnce, initialize_memory);
+
+	if(totalSize >= hugeThreshold)
+	{
+		return huge_malloc(totalSize);
+	}
+
+	if(totalSize > SIZE_BLK_SMALL)
+	{
+		pthread_mutex_lock(&largeLock);
+		char* body = large_malloc(totalSize);
+		char* zeroStart = largeZeroStart;
+		char* zeroEnd = largeZeroEnd;
+		if(body != NULL)
+			add_large_in_use((int64_t)*((size_t*)body - 1));
+		pthread_mutex_unlock(&largeLock);
+
+		if(body == NULL)
+		{
+			return NULL;
+		}
+		count_event(STAT_LARGE_ALLOCS);
+
+		// Only the parts before and after the range of zeros are cleared
+		char* end = body + totalSize;
+		if(zeroStart >= zeroEnd || zeroStart >= end)
+		{
+			zeroStart = end;
+			zeroEnd = end;
+		}
+		memset(body, 0, (size_t)(zeroStart - body));
+		if(zeroEnd < end)
+			memset(zeroEnd, 0, (size_t)(end - zeroEnd));
+		return body;
+	}
+
+	void* body = myMalloc(totalSize);
+	if(body != NULL)
+		memset(body, 0, totalSize);
+	return body;
+}
+
+
+// Puts an in-use small block of a size class with its state in the cache of the thread, or of the CPU
+void small_free(SmallBlock* block, unsigned char* state, int sizeClass)
+{
+	*state = 0;
+	count_event(STAT_SMALL_FREES + sizeClass);
+
+	if(perCpuMode != PERCPU_OFF)
+	{
+		cpu_free(block, sizeClass);
+		return;
+	}
+
+	// The block points to the first free block of the cache of the thread
+	block->nextFree = threadCache.firstFreeBlock[sizeClass];
+	threadCache.firstFreeBlock[sizeClass] = block;
+	threadCache.nbFree[sizeClass]++;
+
+	// When the cache holds too many blocks, a batch of them goes back to the slabs
+	if(threadCache.nbFree[sizeClass] > CACHE_MAX)
+	{
+		flush_cache_blocks(sizeClass, CACHE_BATCH);
+	}
+}
+
+
+// Frees the block associated to the pointer
+void myFree(void* ptr)
+{
+	if(traceFd >= 0 && !isInTracedCall)
+	{
+		traced_free(ptr);
+		return;
+	}
+
+	if(isLatencyEnabled && !isInTimedCall)
+	{
+		timed_free(ptr);
+		return;
+	}
+
+	// Each kind of block checks the pointer with a few loads : the state of its block, the bitmap of the heap or the page map
+	// Small block case : 
+	if(is_slab_address(ptr))
+	{
+		unsigned char* state = small_body_state(ptr);
+
+		// In this case, the address does not points to the start of a block
+		if(state == NULL)
+		{
+			print_error("ERROR : incorrect address.\n");
+			return;
+		}
+
+		if(!(*state & BLOCK_IN_USE))
+		{
+			print_error("ERROR : referenced block not in use.\n");
+			return;
+		}
+
+		if(*state & BLOCK_SAMPLED)
+			remove_sample(ptr, NULL);
+
+		small_free((SmallBlock*)ptr, state, slab_of(ptr)->sizeClass);
+	}
+	else if(is_heap_address(ptr))
+	{
+		// The bitmap of in-use large blocks rejects the addresses inside a block and the blocks already freed before any header is read
+		if(!is_large_body(ptr))
+		{
+			print_error("ERROR : incorrect address or block not in use.\n");
+			return;
+		}
+
+		// The header is read under largeLock, as other threads change its LARGE_PREV_FREE bit while they hold it
+		LargeBlock* freeBlock = (LargeBlock*)((size_t*)ptr - 2);
+		pthread_mutex_lock(&largeLock);
+		if(freeBlock->header & BLOCK_SAMPLED)
+			remove_sample(ptr, NULL);
+		add_large_in_use(-(int64_t)freeBlock->size);
+		large_free(freeBlock);
+		if(purgeDelay >= 0)
+			decay_large_blocks();
+		pthread_mutex_unlock(&largeLock);
+		count_event(STAT_LARGE_FREES);
+	}
+	else
+	{
+		// Any other address must be the body of a huge block, found in the page map
+		HugeBlock* hugeBlock = huge_block_of(ptr);
+		if(hugeBlock == NULL || (void*)hugeBlock->body != ptr)
+		{
+			print_error("ERROR : incorrect address.\n");
+			return;
+		}
+
+		if(hugeBlock->header & BLOCK_SAMPLED)
+			remove_sample(ptr, NULL);
+
+		huge_free(hugeBlock);
+	}
+
+}
+
+
+// Frees the block associated to the pointer, allocated with a body of size bytes
+// A small block goes to the cache of the thread without checking that ptr is the start of a block of its slab,
+// so ptr must have been returned by the allocator. The size is only used for small blocks, other blocks are freed by myFree
+void myFreeSized(void* ptr, size_t size)
+{
+	if(traceFd >= 0 || isLatencyEnabled || size > SIZE_BLK_SMALL || !is_slab_address(ptr))
+	{
+		myFree(ptr);
+		return;
+	}
+
+	// A block aligned by myAlignedAlloc or kept by myRealloc when it shrinks may be in a larger class than its size
+	int sizeClass = small_class_lookup[(size + 7) / 8];
+	Slab* slab = (Slab*)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+	if(slab->sizeClass != sizeClass)
+	{
+		myFree(ptr);
+		return;
+	}
+
+	unsigned char* state = small_class_state((SmallBlock*)ptr, sizeClass);
+	if(!(*state & BLOCK_IN_USE))
+	{
+		print_error("ERROR : referenced block not in use.\n");
+		return;
+	}
+	if(*state & BLOCK_SAMPLED)
+		remove_sample(ptr, NULL);
+
+	small_free((SmallBlock*)ptr, state, sizeClass);
+}
+
+
+// Returns the size of the body of the block that myMalloc would return for size bytes
+// Asking for this size instead of size gets the same block, so a buffer can grow into it without myRealloc
+size_t myGoodSize(size_t size)
+{
+	if(!isInit)
+		pthread_once(&initOnce, initialize_memory);
+
+	if(size <= SIZE_BLK_SMALL)
+		return small_class_size[small_class_lookup[(size + 7) / 8]];
+
+	// Too large for any block, huge_malloc fails and so does myMalloc
+	if(size > SIZE_MAX - sizeof(HugeBlock) - pageSize)
+		return size;
+
+	if(size >= hugeThreshold)
+		return huge_mapping_size(size) - sizeof(HugeBlock);
+
+	// A large body up to the huge threshold keeps the block large
+	size_t goodSize = large_block_size(size) - 2*sizeof(size_t);
+	return goodSize < hugeThreshold ? goodSize : size;
+}
+
+
+// Returns the size of the body of the in-use block starting at ptr, or 0 if ptr is not the body of an in-use block
+size_t in_use_body_size(void* ptr)
+{
+	if(is_slab_address(ptr))
+	{
+		unsigned char* state = small_body_state(ptr);
+		return state != NULL && (*state & BLOCK_IN_USE) ? small_class_size[slab_of(ptr)->sizeClass] : 0;
+	}
+
+	if(is_heap_address(ptr))
+	{
+		return is_large_body(ptr) ? *((size_t*)ptr - 1) - 2*sizeof(size_t) : 0;
+	}
+
+	HugeBlock* hugeBlock = huge_block_of(ptr);
+	return hugeBlock != NULL && (void*)hugeBlock->body == ptr ? hugeBlock->size - 2*sizeof(size_t) : 0;
+}
+
+
+// Returns the size of the body of the block associated to the pointer, at least the size it was allocated with
+// The size is read from the class of a small block or the header of a large or huge block, 0 if ptr is not the body of an in-use block
+size_t myUsableSize(void* ptr)
+{
+	return in_use_body_size(ptr);
+}
+
+
+// Grows the block associated to the pointer without moving it, to maxSize bytes if possible and else to at least minSize bytes
+// Returns the new size of the body, or 0 if the body cannot hold minSize bytes without moving
+size_t myTryExpand(void* ptr, size_t minSize, size_t maxSize)
+{
+	size_t bodySize = in_use_body_size(ptr);
+	if(bodySize == 0)
+	{
+		print_error("ERROR : incorrect address or block not in use.\n");
+		return 0;
+	}
+
+	if(maxSize < minSize)
+		maxSize = minSize;
+
+	// Small blocks always have the size of their class
+	if(bodySize >= minSize || is_slab_address(ptr))
+	{
+		return bodySize >= minSize ? bodySize : 0;
+	}
+
+	// No block can be larger than the reservation of the heap, which also keeps the sizes below from overflowing
+	size_t maxBodySize = (size_t)(heap.reserveEnd - heap.start);
+	if(maxSize > maxBodySize)
+		maxSize = maxBodySize;
+	if(minSize > maxBodySize)
+	{
+		return 0;
+	}
+
+	int hasExpanded;
+	if(!is_heap_address(ptr))
+	{
+		hasExpanded = huge_try_expand((HugeBlock*)((char*)ptr - sizeof(HugeBlock)), minSize, maxSize);
+	}
+	else
+	{
+		pthread_mutex_lock(&largeLock);
+		size_t oldSize = *((size_t*)ptr - 1);
+		hasExpanded = large_try_expand((LargeBlock*)((size_t*)ptr - 2), large_block_size(minSize), large_block_size(maxSize));
+		add_large_in_use((int64_t)(*((size_t*)ptr - 1) - oldSize));
+		pthread_mutex_unlock(&largeLock);
+	}
+
+	return hasExpanded ? *((size_t*)ptr - 1) - 2*sizeof(size_t) : 0;
+}
+
+
+// Frees the block associated to the pointer and reallocate it for new data
+void* myRealloc(void* ptr, size_t size)
+{
+	if(traceFd >= 0 && !isInTracedCall)
+		return traced_realloc(ptr, size);
+
+	if(isLatencyEnabled && !isInTimedCall)
+		return timed_realloc(ptr, size);
+
+	// Here, we check that the pointer is the body of an in-use block, whatever its kind
+	size_t bodySize = in_use_body_size(ptr);
+	if(bodySize == 0)
+	{
+		print_error("ERROR : incorrect address or block not in use.\n");
+		return NULL;
+	}
+
+
+	// Huge blocks are resized in place by the kernel, unless they get smaller than the huge threshold : they are then copied to a large or small block
+	int isHuge = !is_slab_address(ptr) && !is_heap_address(ptr);
+	if(isHuge && size >= hugeThreshold)
+	{
+		void* newPtr = huge_realloc((HugeBlock*)((char*)ptr - sizeof(HugeBlock)), size);
+		// The sample of a block moved by the kernel follows it
+		if(newPtr != NULL && newPtr != ptr && (*((size_t*)newPtr - 2) & BLOCK_SAMPLED))
+			remove_sample(ptr, newPtr);
+		return newPtr;
+	}
+
+	// If the new pointer size is less than the previous pointer size, I try to avoid fragmentation and if not possible, I do nothing
+	if(!isHuge && bodySize > size)
+	{
+		if(bodySize > SIZE_BLK_SMALL && bodySize > size + SIZE_BLK_SMALL + sizeof(size_t))
+		{
+			size_t fullSizeMultSize = large_block_size(size);
+
+			// If the block is too large, I keep the first part of the block for the user (keeping intact the first part of it's data)
+			// and I free the other part
+
+			LargeBlock* currentLargeBlock = (LargeBlock*)((size_t*)ptr - 2);
+			LargeBlock* newBlock = (LargeBlock*)((char*)currentLargeBlock + fullSizeMultSize);
+			newBlock->size = currentLargeBlock->size - fullSizeMultSize;
+			newBlock->header = 1;
+			currentLargeBlock->size = fullSizeMultSize;
+
+			// The end of the block is freed without counting a free of a large block
+			pthread_mutex_lock(&largeLock);
+			add_large_in_use(-(int64_t)newBlock->size);
+			large_free(newBlock);
+			pthread_mutex_unlock(&largeLock);
+
+			return (void*)currentLargeBlock->body;
+		}
+		return ptr;
+	}
+
+
+	// A large block first tries to grow in place, with the free block that follows it or the end of the heap
+	if(!isHuge && !is_slab_address(ptr) && size <= (size_t)(heap.reserveEnd - heap.start))
+	{
+		pthread_mutex_lock(&largeLock);
+		size_t oldSize = *((size_t*)ptr - 1);
+		int hasExpanded = large_try_expand((LargeBlock*)((size_t*)ptr - 2), large_block_size(size), large_block_size(size));
+		add_large_in_use((int64_t)(*((size_t*)ptr - 1) - oldSize));
+		pthread_mutex_unlock(&largeLock);
+		if(hasExpanded)
+		{
+			return ptr;
+		}
+	}
+
+	// The pointer size is too small for the  neww content : I use a malloc-copy-free cycle
+	mark_latency_path(LATENCY_COPY);
+
+	void* newPtr = myMalloc(size);
+
+	if(newPtr == NULL)
+	{
+		print_error("ERROR : no memory available.\n");
+		return NULL;
+	}
+
+	memcpy(newPtr, ptr, bodySize < size ? bodySize : size);
+
+	myFree(ptr);
+
+	return newPtr;
+	
+}
+
+
+
+
+
+
+
+
+
+
+
+// Takes n small blocks of a class from the cache of the thread, refilled with every block still needed (up to a slab of blocks) at once
+// Returns the number of blocks written in out, less than n only if the OS has no memory left
+size_t small_malloc_batch(int sizeClass, size_t n, void** out)
+{
+	size_t slabBlocks = SLAB_SIZE / small_class_size[sizeClass];
+	size_t nbDone = 0;
+	while(nbDone < n)
+	{
+		SmallBlock* block = threadCache.firstFreeBlock[sizeClass];
+		if(block == NULL)
+		{
+			size_t nbWanted = n - nbDone < CACHE_BATCH ? CACHE_BATCH : n - nbDone;
+			block = refill_thread_cache(sizeClass, (int)(nbWanted < slabBlocks ? nbWanted : slabBlocks));
+			if(block == NULL)
+				break;
+		}
+
+		// The chain of the cache is taken at once, up to the blocks still needed
+		int nbTaken = 0;
+		while(block != NULL && nbDone < n)
+		{
+			SmallBlock* nextBlock = block->nextFree;
+			*small_class_state(block, sizeClass) = BLOCK_IN_USE;
+			out[nbDone++] = block;
+			nbTaken++;
+			block = nextBlock;
+		}
+		threadCache.firstFreeBlock[sizeClass] = block;
+		threadCache.nbFree[sizeClass] -= nbTaken;
+		count_events(STAT_SMALL_ALLOCS + sizeClass, (uint64_t)nbTaken);
+	}
+
+	// The blocks taken from the slabs and left unused never keep the cache above its limit, as in myFreeBatch
+	if(threadCache.nbFree[sizeClass] > CACHE_MAX)
+		flush_cache_blocks(sizeClass, threadCache.nbFree[sizeClass] - CACHE_BATCH);
+	return nbDone;
+}
+
+
+// Carves n large blocks with bodies of size bytes from one large block, they are consecutive in memory
+// Returns the number of blocks written in out, the blocks are taken one by one when there is no block large enough for all of them
+size_t large_malloc_batch(size_t size, size_t n, void** out)
+{
+	size_t blockSize = large_block_size(size);
+	size_t nbDone = 0;
+
+	pthread_mutex_lock(&largeLock);
+	if(n <= (size_t)(heap.reserveEnd - heap.start) / blockSize)
+	{
+		char* body = large_malloc(n * blockSize - 2*sizeof(size_t));
+		if(body != NULL)
+		{
+			// The first block keeps the header of the block carved, the last one gets what large_malloc has left in it
+			LargeBlock* firstBlock = (LargeBlock*)((size_t*)body - 2);
+			size_t totalSize = firstBlock->size;
+			for(size_t i = 0; i < n; ++i)
+			{
+				LargeBlock* block = (LargeBlock*)((char*)firstBlock + i * blockSize);
+				if(i > 0)
+				{
+					block->header = 1;
+					set_large_mark(block, 1);
+				}
+				block->size = i < n - 1 ? blockSize : totalSize - (n - 1) * blockSize;
+				out[i] = block->body;
+			}
+			add_large_in_use((int64_t)totalSize);
+			nbDone = n;
+		}
+	}
+	while(nbDone < n)
+	{
+		void* body = large_malloc(size);
+		if(body == NULL)
+			break;
+		add_large_in_use((int64_t)*((size_t*)body - 1));
+		out[nbDone++] = body;
+	}
+	pthread_mutex_unlock(&largeLock);
+
+	count_events(STAT_LARGE_ALLOCS, (uint64_t)nbDone);
+	return nbDone;
+}
+
+
+// Allocates n blocks with bodies of size bytes into out, with the cost of one myMalloc for many blocks
+// Returns the number of blocks allocated, less than n only if no memory is left
+size_t myMallocBatch(size_t size, size_t n, void** out)
+{
+	// The paths below would take a block even for no block at all
+	if(n == 0)
+		return 0;
+
+	// Traced, measured and sampled calls are made one by one, as are small blocks taken from the caches of the CPUs
+	if(traceFd >= 0 || isLatencyEnabled || sampleRate != 0 || size >= hugeThreshold || (perCpuMode != PERCPU_OFF && size <= SIZE_BLK_SMALL))
+	{
+		size_t nbDone = 0;
+		while(nbDone < n && (out[nbDone] = myMalloc(size)) != NULL)
+		{
+			nbDone++;
+		}
+		return nbDone;
+	}
+
+	if(!isInit)
+		pthread_once(&initOnce, initialize_memory);
+
+	size_t nbDone = size > SIZE_BLK_SMALL ? large_malloc_batch(size, n, out) : small_malloc_batch(small_class_lookup[(size + 7) / 8], n, out);
+	if(nbDone < n)
+		print_error("ERROR : no memory available.\n");
+	return nbDone;
+}
+
+
+// Frees the n blocks of ptrs, with the cost of one myFree for many blocks
+// Small blocks go to the cache of the thread, which is flushed once at the end (or to the cache of the CPU), and large blocks are freed under one lock
+void myFreeBatch(void** ptrs, size_t n)
+{
+	if(traceFd >= 0 || isLatencyEnabled)
+	{
+		for(size_t i = 0; i < n; ++i)
+		{
+			myFree(ptrs[i]);
+		}
+		return;
+	}
+
+	int hasLargeLock = 0;
+	uint64_t nbLargeFreed = 0;
+	// Consecutive small blocks of the same class are counted at once
+	int runClass = 0;
+	uint64_t nbRunFreed = 0;
+	for(size_t i = 0; i < n; ++i)
+	{
+		void* ptr = ptrs[i];
+
+		// A slab address is always safe, the other addresses are checked as in myFree
+		if(is_slab_address(ptr))
+		{
+			unsigned char* state = small_body_state(ptr);
+			if(state == NULL || !(*state & BLOCK_IN_USE))
+			{
+				print_error("ERROR : incorrect address or block not in use.\n");
+				continue;
+			}
+
+			// small_body_state has checked the slab
+			int sizeClass = ((Slab*)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1)))->sizeClass;
+			if(*state & BLOCK_SAMPLED)
+			{
+				if(hasLargeLock)
+				{
+					pthread_mutex_unlock(&largeLock);
+					hasLargeLock = 0;
+				}
+				remove_sample(ptr, NULL);
+			}
+
+			*state = 0;
+			if(perCpuMode != PERCPU_OFF)
+			{
+				cpu_free((SmallBlock*)ptr, sizeClass);
+			}
+			else
+			{
+				((SmallBlock*)ptr)->nextFree = threadCache.firstFreeBlock[sizeClass];
+				threadCache.firstFreeBlock[sizeClass] = (SmallBlock*)ptr;
+				threadCache.nbFree[sizeClass]++;
+			}
+			if(sizeClass != runClass && nbRunFreed > 0)
+			{
+				count_events(STAT_SMALL_FREES + runClass, nbRunFreed);
+				nbRunFreed = 0;
+			}
+			runClass = sizeClass;
+			nbRunFreed++;
+			continue;
+		}
+
+		// Huge blocks are checked with the page map, then freed one by one as in myFree
+		if(!is_heap_address(ptr))
+		{
+			HugeBlock* hugeBlock = huge_block_of(ptr);
+			if(hugeBlock == NULL || (void*)hugeBlock->body != ptr)
+			{
+				print_error("ERROR : incorrect address.\n");
+				continue;
+			}
+			if(hasLargeLock)
+			{
+				pthread_mutex_unlock(&largeLock);
+				hasLargeLock = 0;
+			}
+			if(hugeBlock->header & BLOCK_SAMPLED)
+				remove_sample(ptr, NULL);
+			huge_free(hugeBlock);
+			continue;
+		}
+
+		if(!is_large_body(ptr))
+		{
+			print_error("ERROR : incorrect address or block not in use.\n");
+			continue;
+		}
+
+		// largeLock is kept from one large block to the next, and the sampled bit is tested under it as in myFree
+		LargeBlock* freeBlock = (LargeBlock*)((size_t*)ptr - 2);
+		if(!hasLargeLock)
+		{
+			pthread_mutex_lock(&largeLock);
+			hasLargeLock = 1;
+		}
+		if(freeBlock->header & BLOCK_SAMPLED)
+			remove_sample(ptr, NULL);
+		add_large_in_use(-(int64_t)freeBlock->size);
+		large_free(freeBlock);
+		nbLargeFreed++;
+	}
+
+	if(hasLargeLock)
+	{
+		if(purgeDelay >= 0)
+			decay_large_blocks();
+		pthread_mutex_unlock(&largeLock);
+	}
+	if(nbLargeFreed > 0)
+		count_events(STAT_LARGE_FREES, nbLargeFreed);
+	if(nbRunFreed > 0)
+		count_events(STAT_SMALL_FREES + runClass, nbRunFreed);
+
+	// The caches that hold too many blocks give back all but a batch of them at once
+	for(int i = 0; i < NB_SMALL_CLASSES; ++i)
+	{
+		if(threadCache.nbFree[i] > CACHE_MAX)
+			flush_cache_blocks(i, threadCache.nbFree[i] - CACHE_BATCH);
+	}
+}
+
+
+
+
+
+
+
+
+
+// Arenas
+
+// Default size of the chunks of an arena, below the huge threshold so that chunks are carved from the heap of large blocks
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+// Memory of an arena, a block of the allocator whose body holds the chunk header then the objects
+struct ArenaChunk_s
+{
+	struct ArenaChunk_s* nextChunk;
+	// End of the body of the block
+	char* end;
+	char body[];
+};
+
+typedef struct ArenaChunk_s ArenaChunk;
+
+// The chunks of an arena are kept in a chained list, those after currentChunk are empty and reused before new ones are taken
+struct MyArena_s
+{
+	ArenaChunk* firstChunk;
+	ArenaChunk* currentChunk;
+	// Free part of the current chunk
+	char* next;
+	char* end;
+	size_t chunkSize;
+};
+
+
+// Creates an empty arena whose chunks hold chunkSize bytes (ARENA_CHUNK_SIZE when chunkSize is 0), returns NULL if no memory is left
+MyArena* myArenaCreate(size_t chunkSize)
+{
+	MyArena* arena = myMalloc(sizeof(MyArena));
+	if(arena == NULL)
+		return NULL;
+
+	arena->firstChunk = NULL;
+	arena->currentChunk = NULL;
+	arena->next = NULL;
+	arena->end = NULL;
+	arena->chunkSize = chunkSize > 0 ? chunkSize : ARENA_CHUNK_SIZE;
+	return arena;
+}
+
+
+// Makes the next chunk of an arena current, taking a new chunk from the allocator when there is none with at least size bytes
+// Returns 0 if no memory is left
+int next_arena_chunk(MyArena* arena, size_t size)
+{
+	ArenaChunk* chunk = arena->currentChunk != NULL ? arena->currentChunk->nextChunk : arena->firstChunk;
+	if(chunk == NULL || (size_t)(chunk->end - chunk->body) < size)
+	{
+		size_t bodySize = size > arena->chunkSize ? size : arena->chunkSize;
+		if(bodySize > SIZE_MAX - sizeof(ArenaChunk))
+			return 0;
+		ArenaChunk* newChunk = myMalloc(sizeof(ArenaChunk) + bodySize);
+		if(newChunk == NULL)
+			return 0;
+
+		// The chunk too small stays after the new one, to be used later
+		newChunk->nextChunk = chunk;
+		newChunk->end = newChunk->body + bodySize;
+		if(arena->currentChunk != NULL)
+			arena->currentChunk->nextChunk = newChunk;
+		else
+			arena->firstChunk = newChunk;
+		chunk = newChunk;
+	}
+
+	arena->currentChunk = chunk;
+	arena->next = chunk->body;
+	arena->end = chunk->end;
+	return 1;
+}
+
+
+// Returns a pointer to size bytes aligned on BODY_ALIGN bytes taken from the arena, NULL if no memory is left
+// The memory cannot be given to myFree, it is freed with the whole arena by myArenaReset or myArenaDestroy
+void* myArenaAlloc(MyArena* arena, size_t size)
+{
+	if(size > SIZE_MAX - BODY_ALIGN)
+	{
+		print_error("ERROR : no memory available in the arena.\n");
+		return NULL;
+	}
+	// Every allocation gets its own address, even of 0 bytes
+	size = size > 0 ? (size + BODY_ALIGN - 1) & ~(size_t)(BODY_ALIGN - 1) : BODY_ALIGN;
+
+	// Most allocations only move the pointer of the current chunk
+	if(size > (size_t)(arena->end - arena->next) && !next_arena_chunk(arena, size))
+	{
+		print_error("ERROR : no memory available in the arena.\n");
+		return NULL;
+	}
+
+	void* ptr = arena->next;
+	arena->next += size;
+	return ptr;
+}
+
+
+// Frees everything allocated from the arena at once, its chunks are kept to be reused by the next allocations
+void myArenaReset(MyArena* arena)
+{
+	arena->currentChunk = arena->firstChunk;
+	arena->next = arena->firstChunk != NULL ? arena->firstChunk->body : NULL;
+	arena->end = arena->firstChunk != NULL ? arena->firstChunk->end : NULL;
+}
+
+
+// Frees everything allocated from the arena and gives its chunks back to the allocator
+void myArenaDestroy(MyArena* arena)
+{
+	ArenaChunk* chunk = arena->firstChunk;
+	while(chunk != NULL)
+	{
+		ArenaChunk* nextChunk = chunk->nextChunk;
+		myFree(chunk);
+		chunk = nextChunk;
+	}
+	myFree(arena);
+}
+
+
+
+
+
+
+
+
+
+// Prints the list of free large block on the heap with their size, address, header and bin
+void print_large_blocks_used()
+{
+	int counter = 0;
+
+	pthread_mutex_lock(&largeLock);
+
+	printf("State of large blocks memory : \n");
+
+	if(largeFlBitmap == 0)
+	{
+		printf("No large blocks in the bins.\n");
+	}
+
+	for(int fl = 0; fl < LARGE_FL_COUNT; ++fl)
+	{
+		for(int sl = 0; sl < LARGE_SL_COUNT; ++sl)
+		{
+			for(LargeBlock* currentLargeBlock = largeBins[fl][sl]; currentLargeBlock != NULL; currentLargeBlock = (LargeBlock*)currentLargeBlock->header)
+			{
+				printf("Large block %d with address %p has a size of %d and a header of %p (bin %d.%d)\n", counter, (void*)currentLargeBlock, (int)currentLargeBlock->size, (void*)currentLargeBlock->header, fl, sl);
+				counter++;
+			}
+		}
+	}
+
+	pthread_mutex_lock(&hugeLock);
+	for(HugeBlock* hugeBlock = hugeBlocks; hugeBlock != NULL; hugeBlock = hugeBlock->next)
+	{
+		printf("Huge block with address %p has its own mapping of %d bytes\n", (void*)hugeBlock, (int)huge_block_mapping_size(hugeBlock));
+	}
+	pthread_mutex_unlock(&hugeLock);
+
+	printf("End of state of large blocks memory.\n");
+
+	pthread_mutex_unlock(&largeLock);
+}
+
+// Returns the number of in-use blocks of a slab, counting the states eight at a time
+int count_slab_in_use(Slab* slab)
+{
+	unsigned char* states = slab_states(slab);
+	int nbInUse = 0;
+	int i = 0;
+	for(; i + 8 <= slab->nbBlocks; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, states + i, sizeof(word));
+		nbInUse += __builtin_popcountll(word & 0x0101010101010101ull);
+	}
+	for(; i < slab->nbBlocks; ++i)
+	{
+		nbInUse += states[i] & BLOCK_IN_USE;
+	}
+	return nbInUse;
+}
+
+
+// Shows which blocks of memory are used ( x if used and o for free) in each slab
+void print_small_blocks_used()
+{
+	pthread_mutex_lock(&slabLock);
+
+	printf("State of small blocks memory (%d slabs) : \n", nbSlabs);
+
+	for(Slab* slab = allSlabs; slab != NULL; slab = slab->nextSlab)
+	{
+		size_t blockSize = small_class_size[slab->sizeClass];
+		unsigned char* states = slab_states(slab);
+
+		printf("Slab %p (blocks of %d bytes, %d/%d out of the slab, %d in use) : ", (void*)slab, (int)blockSize, slab->nbUsed, slab->nbBlocks, count_slab_in_use(slab));
+		for(int i = 0; i < slab->nbBlocks; ++i)
+		{
+			printf("%c", states[i] & BLOCK_IN_USE ? 'x' : 'o');
+		}
+		printf("\n");
+	}
+
+	printf("End of state of small blocks memory.\n");
+
+	pthread_mutex_unlock(&slabLock);
+}
+
+
+// Shows the content of a block by displaying the ascii representation of each of its bytes
+void print_block_content(void* ptr)
+{
+	if(is_slab_address(ptr))
+	{
+		SmallBlock* currentBlock = small_block_of(ptr);
+		if(currentBlock == NULL)
+		{
+			print_error("ERROR : incorrect address.\n");
+			return;
+		}
+		Slab* slab = slab_of(ptr);
+		size_t blockSize = small_class_size[slab->sizeClass];
+		int blockID = (int)( ((char*)currentBlock - slab_blocks(slab)) / blockSize );
+
+		printf("Content of the %dth small block of slab %p (address %p) : \n", blockID, (void*)slab, (void*)currentBlock);
+		for (unsigned int i = 0; i < blockSize; ++i)
+		{
+			printf("%c/", ((char*)currentBlock)[i]);
+		}
+		printf("\nEnd of the %dth small block of slab %p (address %p).\n", blockID, (void*)slab, (void*)currentBlock);
+	}
+	else
+	{
+		LargeBlock* currentLargeBlock = (LargeBlock*)((size_t*)ptr - 2);
+
+		printf("Content of large block with size %d (address %p) : \n", (int)currentLargeBlock->size, (void*)currentLargeBlock);
+		for (unsigned int i = 0; i < currentLargeBlock->size - 2*sizeof(size_t); ++i)
+		{
+			printf("%c/", *((char*)currentLargeBlock->body + i));
+		}
+		printf("\nEnd of large block with size %d (address %p).\n", (int)currentLargeBlock->size, (void*)currentLargeBlock);
+	}
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+// Returns int at a pointer address in memory after checking that the pointer is valid
+int read_safe_int_small(void* ptr)
+{
+	if(!is_memory_safe(ptr))
+	{
+		print_error("ERROR : incorrect address.\n");
+		return 0;
+	}
+
+	if(!is_slab_address(ptr))
+	{
+		print_error("ERROR : read_safe_int_small can only read from small blocks.\n");
+		return 0;
+	}
+
+	// Get the block associated with the pointer, this time the pointer can point anywhere in the body
+	unsigned char* state = small_block_state(ptr, NULL);
+	if(state == NULL || !(*state & BLOCK_IN_USE))
+	{
+		print_error("ERROR : referenced block not in use.\n");
+		return 0;
+	}
+
+	return *((int*)ptr);
+
+}
+
+// Returns char at a pointer address in memory after checking that the pointer is valid
+char read_safe_char_small(void* ptr)
+{
+	if(!is_memory_safe(ptr))
+	{
+		print_error("ERROR : incorrect address.\n");
+		return 0;
+	}
+	if(!is_slab_address(ptr))
+	{
+		print_error("ERROR : read_safe_char_small can only read from small blocks.\n");
+		return 0;
+	}
+	// Get the block associated with the pointer, this time the pointer can point anywhere in the body
+	unsigned char* state = small_block_state(ptr, NULL);
+	if(state == NULL || !(*state & BLOCK_IN_USE))
+	{
+		print_error("ERROR : referenced block not in use.\n");
+		return 0;
+	}
+
+	return *((char*)ptr);
+
+}
+
+// Writes int at a pointer address in memory after checking that the pointer is valid
+void write_safe_int_small(void* ptr,int value)
+{
+	//                          Check if the (int) value is written inside the memory
+	if(!is_memory_safe(ptr) || !is_memory_safe((char*)ptr + sizeof(int) - 1))
+	{
+		print_error("ERROR : incorrect address.\n");
+		return;
+	}
+	if(!is_slab_address(ptr))
+	{
+		print_error("ERROR : write_safe_int_small can only write in small blocks.\n");
+		return;
+	}
+	// Get the block associated with the pointer, this time the pointer can point anywhere in the body
+	unsigned char* state = small_block_state(ptr, NULL);
+	if(state == NULL || !(*state & BLOCK_IN_USE))
+	{
+		print_error("ERROR : referenced block not in use.\n");
+		return;
+	}
+
+	*((int*)ptr) = value;
+
+}
+
+// Writes char at a pointer address in memory after checking that the pointer is valid
+void write_safe_char_small(void* ptr,char value)
+{
+	//                          Check if the (char) value is written inside the memory
+	if(!is_memory_safe(ptr))
+	{
+		print_error("ERROR : incorrect address.\n");
+		return;
+	}
+	if(!is_slab_address(ptr))
+	{
+		print_error("ERROR : write_safe_char_small can only write in small blocks.\n");
+		return;
+	}
+	// Get the block associated with the pointer, this time the pointer can point anywhere in the body
+	unsigned char* state = small_block_state(ptr, NULL);
+	if(state == NULL || !(*state & BLOCK_IN_USE))
+	{
+		print_error("ERROR : referenced block not in use.\n");
+		return;
+	}
+
+	*((char*)ptr) = value;
+
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+void test_large_block1()
+{
+	print_small_blocks_used();
+	print_large_blocks_used();
+
+	char* tab = myMalloc(70 * sizeof(char));
+
+	for(int i = 0 ; i < 58; i++)
+	{
+		tab[i] = (char)('A'+i);
+	}
+
+	printf("Malloc array of 70 chars and has written the letters of the alphabet\n");
+
+	print_block_content(tab);
+
+	print_large_blocks_used();
+
+	print_small_blocks_used();
+
+	char* tab2 = myRealloc(tab, sizeof(uint64_t) * 200);
+
+	printf("Realloc the char array to a 200 elements array of 64 bits unsigned integers\n");
+
+	print_block_content(tab2);
+
+	print_large_blocks_used();
+
+	print_small_blocks_used();
+
+	myFree(tab2);
+
+	printf("Free the unsigned int array\n");
+
+	print_large_blocks_used();
+}
+
+void test_large_block2()
+{
+	print_small_blocks_used();
+	print_large_blocks_used();
+
+	char* tab = myMalloc(100 * sizeof(char));
+
+	printf("Malloc array of 100 chars\n");
+
+	print_small_blocks_used();
+
+	uint64_t* tab2 = myMalloc(200 * sizeof(uint64_t));
+
+	printf("Malloc array of 200 uint64_t\n");
+
+	print_large_blocks_used();
+
+	int* tab3 = myMalloc(300 * sizeof(int));
+
+	printf("Malloc array of 300 int\n");
+
+	print_large_blocks_used();
+
+	myFree(tab3);
+
+	printf("Free array of 300 int\n");
+
+	print_large_blocks_used();
+
+	for (size_t i = 0; i < 100; i++)
+	{
+		tab2[i] = i*i;
+	}
+
+	printf("Write squares in uint_64 array\n");
+
+	print_block_content(tab2);
+
+	char* tab4 = myMalloc(1024 * sizeof(char));
+
+	printf("Malloc array of 1024 chars\n");
+
+	print_large_blocks_used();
+
+
+	float* tab5 = myRealloc(tab2, 10*sizeof(float));
+
+	printf("Realloc array of 200 uint64 to 10 float\n");
+
+	print_block_content(tab5);
+	print_large_blocks_used();
+
+	myFree(tab);
+	printf("Free array of 100 char\n");
+	print_large_blocks_used();
+
+
+	myFree(tab5);
+	printf("Free array of 10 float\n");
+	print_large_blocks_used();
+
+	myFree(tab4);
+	printf("Free array of 1024 char\n");
+	print_large_blocks_used();
+
+	print_small_blocks_used();
+
+	printf("Error because i try to free memory that is not in the heap yet :\n");
+	myFree(tab5 + 3000);
+
+
+	
+}
+
+
+
+
+void test_large_block3()
+{
+	char* tab1 = myMalloc(2000);
+	char* tab2 = myMalloc(3000);
+	char* tab3 = myMalloc(4000);
+	char* tab4 = myMalloc(5000);
+
+	printf("Malloc arrays of 2000, 3000, 4000 and 5000 chars\n");
+
+	print_large_blocks_used();
+
+	myFree(tab1);
+	myFree(tab3);
+
+	printf("Free arrays of 2000 and 4000 chars\n");
+
+	print_large_blocks_used();
+
+	myFree(tab2);
+
+	printf("Free array of 3000 chars, it is merged with both of its free neighbours into a single block\n");
+
+	print_large_blocks_used();
+
+	myFree(tab4);
+
+	printf("Free array of 5000 chars\n");
+
+	print_large_blocks_used();
+}
+
+
+
+
+void test_expand()
+{
+	char* tab1 = myMalloc(2000);
+	char* tab2 = myMalloc(3000);
+	char* tab3 = myMalloc(2000);
+
+	printf("Malloc arrays of 2000, 3000 and 2000 chars\n");
+
+	myFree(tab2);
+
+	printf("Free the array of 3000 chars\n");
+
+	print_large_blocks_used();
+
+	size_t newSize = myTryExpand(tab1, 3000, 4000);
+
+	printf("Expand the first array in place to 4000 chars or at least 3000 chars : the body now has %d chars\n", (int)newSize);
+
+	print_large_blocks_used();
+
+	printf("Expanding it to 10000 chars fails because there is not enough free space after it : %d\n", (int)myTryExpand(tab1, 10000, 10000));
+
+	char* tab4 = myRealloc(tab3, 20000);
+
+	printf("Realloc the last array of the heap to 20000 chars : %s\n", tab4 == tab3 ? "it has not moved" : "it has moved");
+
+	print_large_blocks_used();
+
+	myFree(tab1);
+	myFree(tab4);
+}
+
+
+
+
+void test_aligned()
+{
+	char* tab1 = myAlignedAlloc(64, 8);
+	char* tab2 = myAlignedAlloc(32, 100);
+	char* tab3 = myAlignedAlloc(64, 3000);
+	char* tab4 = myAlignedAlloc(4096, 10000);
+
+	printf("Aligned alloc of 8 chars on 64 bytes : %p (address %% 64 = %d)\n", (void*)tab1, (int)((uintptr_t)tab1 % 64));
+	printf("Aligned alloc of 100 chars on 32 bytes : %p (address %% 32 = %d)\n", (void*)tab2, (int)((uintptr_t)tab2 % 32));
+	printf("Aligned alloc of 3000 chars on 64 bytes : %p (address %% 64 = %d)\n", (void*)tab3, (int)((uintptr_t)tab3 % 64));
+	printf("Aligned alloc of 10000 chars on 4096 bytes : %p (address %% 4096 = %d)\n", (void*)tab4, (int)((uintptr_t)tab4 % 4096));
+
+	printf("The padding before the large aligned blocks went back to the bins : \n");
+
+	print_large_blocks_used();
+
+	printf("Error because the alignment is not a power of two : \n");
+	myAlignedAlloc(48, 100);
+
+	myFree(tab1);
+	myFree(tab2);
+	myFree(tab3);
+	myFree(tab4);
+
+	size_t size = 1024 * 1024;
+	char* tab5 = myAlignedAlloc(64, size);
+	char* tab6 = myAlignedAlloc(2 * size, size);
+	for (size_t i = 0; i < size; i++)
+	{
+		tab5[i] = 'A';
+		tab6[i] = 'B';
+	}
+
+	printf("Aligned alloc of %d chars on 64 bytes : %p (address %% 64 = %d)\n", (int)size, (void*)tab5, (int)((uintptr_t)tab5 % 64));
+	printf("Aligned alloc of %d chars on %d bytes : %p (address %% %d = %d)\n", (int)size, (int)(2 * size), (void*)tab6, (int)(2 * size), (int)((uintptr_t)tab6 % (2 * size)));
+	printf("Both arrays have their own mapping, without the pages used to align them : \n");
+
+	print_large_blocks_used();
+
+	tab6 = myRealloc(tab6, 4 * size);
+	int nbErrors = 0;
+	for (size_t i = 0; i < size; i++)
+	{
+		nbErrors += tab6[i] != 'B';
+	}
+	printf("Realloc the second array to %d chars, found %d changed chars\n", (int)(4 * size), nbErrors);
+
+	myFree(tab5);
+	myFree(tab6);
+
+	printf("Free both arrays, their mappings are given back to the OS\n");
+
+	print_large_blocks_used();
+
+	// A huge block whose header is not at the start of its mapping, shrunk below the huge threshold
+	char* tab7 = myAlignedAlloc(4096, 300000);
+	memset(tab7, 'C', 300000);
+	tab7 = myRealloc(tab7, 0);
+	printf("Aligned alloc of 300000 chars on 4096 bytes reallocated to 0 chars : %d usable chars\n", (int)myUsableSize(tab7));
+	myFree(tab7);
+
+	printf("Free it, its mapping was given back to the OS by the realloc\n");
+
+	print_large_blocks_used();
+}
+
+
+
+
+void test_calloc()
+{
+	int* tab1 = myCalloc(5000, sizeof(int));
+
+	printf("Calloc array of 5000 ints, only the part that is not fresh memory from the OS is cleared\n");
+
+	int nbNonZero = 0;
+	for (int i = 0; i < 5000; i++)
+	{
+		nbNonZero += tab1[i] != 0;
+		tab1[i] = i + 1;
+	}
+	printf("Found %d non zero ints, then wrote in every int\n", nbNonZero);
+
+	myFree(tab1);
+
+	int* tab2 = myCalloc(4000, sizeof(int));
+
+	printf("Free the array and calloc an array of 4000 ints, it reuses the written memory so it is cleared\n");
+
+	nbNonZero = 0;
+	for (int i = 0; i < 4000; i++)
+	{
+		nbNonZero += tab2[i] != 0;
+	}
+	printf("Found %d non zero ints\n", nbNonZero);
+
+	myFree(tab2);
+
+	printf("Error because the size of the array overflows : \n");
+	myCalloc(SIZE_MAX / 2, 4);
+}
+
+
+
+
+void test_huge_block()
+{
+	size_t size = 1024 * 1024;
+	char* tab = myMalloc(size);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		tab[i] = (char)('A' + i % 26);
+	}
+
+	printf("Malloc array of %d chars and has written the letters of the alphabet\n", (int)size);
+
+	print_large_blocks_used();
+
+	char* tab2 = myRealloc(tab, 16 * size);
+
+	printf("Realloc the char array to %d chars, the mapping is grown by the kernel\n", (int)(16 * size));
+
+	int nbErrors = 0;
+	for (size_t i = 0; i < size; i++)
+	{
+		nbErrors += tab2[i] != (char)('A' + i % 26);
+	}
+	printf("Found %d changed chars after the realloc\n", nbErrors);
+
+	print_large_blocks_used();
+
+	myFree(tab2);
+
+	printf("Free the array, its mapping is given back to the OS\n");
+
+	print_large_blocks_used();
+
+	printf("Error because the array was already freed : \n");
+	myFree(tab2);
+
+	printf("Error because the size of the mapping overflows : \n");
+	char* tab3 = myMalloc(SIZE_MAX - 10);
+	printf("Malloc of %zu chars returned %p\n", (size_t)(SIZE_MAX - 10), (void*)tab3);
+
+	tab = myMalloc(size);
+	printf("Error because the size of the mapping overflows : \n");
+	tab2 = myRealloc(tab, SIZE_MAX - 10);
+	printf("Realloc to %zu chars returned %p, the array keeps %zu usable chars\n", (size_t)(SIZE_MAX - 10), (void*)tab2, myUsableSize(tab));
+	myFree(tab);
+}
+
+
+
+
+#define NB_TRIM_BLOCKS 40
+
+void test_trim()
+{
+	char* tabs[NB_TRIM_BLOCKS];
+	for (int i = 0; i < NB_TRIM_BLOCKS; i++)
+	{
+		tabs[i] = myMalloc(60000);
+		for (int j = 0; j < 60000; j++)
+		{
+			tabs[i][j] = 'A';
+		}
+	}
+
+	printf("Malloc and write %d arrays of 60000 chars, %d bytes of the heap are committed\n", NB_TRIM_BLOCKS, (int)(heap.commitEnd - heap.start));
+
+	for (int i = 1; i < NB_TRIM_BLOCKS; i++)
+	{
+		myFree(tabs[i]);
+	}
+
+	printf("Free every array except the first one, %d bytes of the heap are still committed\n", (int)(heap.commitEnd - heap.start));
+
+	print_large_blocks_used();
+
+	int hasTrimmed = myTrim(0);
+
+	printf("Trim the heap (returned %d), %d bytes of the heap are committed\n", hasTrimmed, (int)(heap.commitEnd - heap.start));
+
+	print_large_blocks_used();
+
+	mySetPurgeDelay(0);
+
+	char* tab = myMalloc(100000);
+	myFree(tab);
+
+	printf("Set a purge delay of 0 ms then malloc and free an array of 100000 chars, %d bytes of the heap are committed\n", (int)(heap.commitEnd - heap.start));
+
+	mySetPurgeDelay(-1);
+	myFree(tabs[0]);
+
+	// A large block shrunk by myRealloc and then freed must keep its footer when its pages are purged
+	char* a = myMalloc(5000);
+	char* b = myMalloc(5000);
+	char* d = myMalloc(5000);
+	b = myRealloc(b, 8);
+	char* f = myMalloc(4960);
+
+	printf("Shrink a large array to 8 chars, its block keeps %d bytes\n", (int)*((size_t*)b - 1));
+
+	myFree(b);
+	myTrim(0);
+	myFree(f);
+
+	printf("Free it, trim the heap and free the array that follows it\n");
+
+	print_large_blocks_used();
+
+	myFree(a);
+	myFree(d);
+}
+
+
+
+
+void test_general()
+{
+	// Alocating an int[5]
+	int* ptr = (int*)( myMalloc(5*sizeof(int)) );
+	printf("Just allocated memory for a 5 int array with body pointer : %p\n", (void*)ptr);
+	printf("Slab of the array : %p\n", (void*)slab_of(ptr));
+
+	*(ptr) = 12000;
+	*(ptr + 1) = -100;
+	*(ptr + 2) = 333;
+	*(ptr + 3) = 0;
+	*(ptr + 4) = -3;
+
+	printf("Setting up the value of each element of the array.\n");
+
+
+	write_safe_int_small(ptr + 1, 42);
+	printf("Just wrote int %d at the address : %p\n", 42, (void*)(ptr + 1));
+
+
+
+	print_block_content(ptr);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		// I can print content of the array
+		read_safe_int_small(ptr + i);
+		printf("Just read int %d at the address : %p\n", *((int*)(ptr + i)), (void*)(ptr + i));
+		read_safe_char_small(ptr + i);
+		printf("Just read char %c at the address : %p\n", *((char*)(ptr + i)), (void*)(ptr + i));
+	}
+
+	int* ptr1 = (int*)( myMalloc(sizeof(int)) );
+	printf("Just allocated memory with body pointer : %p\n", (void*)ptr1);
+
+
+
+	myFree((void*)ptr);
+	printf("Just freed block with address : %p\n", (void*)ptr);
+
+	printf("Block is already freed, 8 errors : \n");
+
+	for (int i = 0; i < 4; ++i)
+	{
+		// Error : the block was freed
+		read_safe_int_small(ptr + i);
+		read_safe_char_small(ptr + i);
+	}
+
+	write_safe_int_small(ptr1, -23987);
+	printf("Just wrote int %d at the address : %p\n", -23987, (void*)(ptr1));
+
+	print_block_content(ptr1);
+
+	char* ptr2 = (char*)( myRealloc((void*)ptr1, sizeof(char)) );
+	printf("Just reallocated memory with body pointer : %p \n", (void*)ptr2);
+
+
+	// I reallocate the block associated with ptr1 and use it to store a char @
+	write_safe_char_small(ptr2, '@');
+	printf("Just wrote int %c at the address : %p\n", '@', (void*)ptr2);
+
+
+	// @ can be seen at the first byte of the block 1
+	print_block_content(ptr2);
+
+	// Only 1 is used (0)
+	print_small_blocks_used();
+
+	myFree((void*)ptr2);
+
+	printf("Just freed block with address : %p\n", (void*)ptr2);
+
+	print_small_blocks_used();
+}
+
+void test_free1()
+{
+	int* ptr = (int*)( myMalloc(5*sizeof(int)) );
+	printf("Just allocated memory with body pointer : %p\n", (void*)ptr);
+	char* ptr1 = (char*)( myMalloc(2*sizeof(char)) );
+	printf("Just allocated memory with body pointer : %p\n", (void*)ptr1);
+	myFree(ptr1);
+	printf("Just freed block with address : %p\n", (void*)ptr1);
+	size_t* ptr2 = (size_t*)( myMalloc(sizeof(size_t)) );
+	printf("Just allocated memory with body pointer : %p\n", (void*)ptr2);
+	long* ptr3 = (long*)( myMalloc(3*sizeof(long)) );
+	printf("Just allocated memory with body pointer : %p\n", (void*)ptr3);
+
+	// Only three blocks used
+	print_small_blocks_used();
+
+	myFree(ptr);
+	printf("Just freed block with address : %p\n", (void*)ptr);
+	myFree(ptr3);
+	printf("Just freed block with address : %p\n", (void*)ptr3);
+	myFree(ptr2);
+	printf("Just freed block with address : %p\n", (void*)ptr2);
+
+	// No block used
+	print_small_blocks_used();
+}
+
+void test_free2()
+{
+	char* ptr = (char*)( myMalloc(5*sizeof(char)) );
+	printf("Just allocated memory with body pointer : %p\n", (void*)ptr);
+
+	// One block used
+	print_small_blocks_used();
+
+	myFree(ptr);
+	printf("Just freed block with address : %p\n", (void*)ptr);
+	// Error : already feed
+	printf("Error because the block was already freed : \n");
+	myFree(ptr);
+	printf("Just freed block with address : %p\n", (void*)ptr);
+
+	// No block used
+	print_small_blocks_used();
+}
+
+void test_malloc1()
+{
+	// Here, I allocate far more blocks than a single slab can hold : new slabs are taken from the OS when needed
+
+	int nbBlocks = 4 * small_class_nb_blocks[NB_SMALL_CLASSES - 1] + 5;
+	long** ptrs = (long**)myMalloc(nbBlocks * sizeof(long*));
+	int nbSlabsBefore = nbSlabs;
+
+	for (int i = 0; i < nbBlocks; ++i)
+	{
+		ptrs[i] = (long*)(myMalloc(SIZE_BLK_SMALL));
+		write_safe_int_small(ptrs[i], -i*i*i);
+	}
+	printf("Just allocated %d blocks of %d bytes, %d new slabs were needed\n", nbBlocks, (int)SIZE_BLK_SMALL, nbSlabs - nbSlabsBefore);
+	printf("Int %d read at the address of the last block : %p\n", read_safe_int_small(ptrs[nbBlocks - 1]), (void*)ptrs[nbBlocks - 1]);
+
+	for (int i = 0; i < nbBlocks; ++i)
+	{
+		myFree(ptrs[i]);
+	}
+	myFree(ptrs);
+	printf("Just freed the %d blocks\n", nbBlocks);
+
+	print_small_blocks_used();
+}
+
+void test_malloc2()
+{
+	printf("Error because trying to store a 128 int array in a smallblock : \n");
+	int* ptr = (int*)( myMalloc(128*sizeof(int)) );
+	print_small_blocks_used();
+	printf("Error because the int array was never allocated : \n");
+	myFree(ptr);
+}
+
+void test_realloc()
+{
+	int* ptr1 = (int*)myMalloc(sizeof(int));
+	printf("Just allocated memory with body pointer : %p\n", (void*)ptr1);
+    int* ptr2 = (int*)myMalloc(sizeof(int));
+    printf("Just allocated memory with body pointer : %p\n", (void*)ptr2);
+    
+    write_safe_int_small(ptr1, 6789);
+    printf("Just wrote int %d at the address : %p\n", 6789, (void*)(ptr1));
+
+    print_block_content(ptr1);
+
+
+    ptr1 = (int *)myRealloc(ptr1,10 * sizeof(int));
+    printf("Just reallocated memory with body pointer : %p \n", (void*)ptr1);
+
+
+    write_safe_int_small(ptr1, -5);
+    printf("Just wrote int %d at the address : %p\n", -5, (void*)(ptr1));
+    write_safe_int_small(ptr1 + 1, 20);
+    printf("Just wrote int %d at the address : %p\n", 20, (void*)(ptr1+1));
+    write_safe_int_small(ptr1 + 2, -35);
+    printf("Just wrote int %d at the address : %p\n", -35, (void*)(ptr1+2));
+
+    print_block_content(ptr1);
+
+    myFree(ptr1);
+    printf("Just freed block with address : %p\n", (void*)ptr1);
+    myFree(ptr2);
+    printf("Just freed block with address : %p\n", (void*)ptr2);
+
+    print_block_content(ptr1);
+}
+
+
+void test_header()
+{
+	print_small_blocks_used();
+
+	int* test = myMalloc(sizeof(int));
+	printf("Just allocated memory with body pointer : %p\n", (void*)test);
+
+	write_safe_int_small(test, -177);
+	printf("Just wrote int %d at the address : %p\n", -177, (void*)(test));
+
+	print_small_blocks_used();
+
+	char* test2 = myMalloc(sizeof(char)*10);
+	printf("Just allocated memory with body pointer : %p\n", (void*)test2);
+
+	write_safe_int_small(test2, 'E');
+	printf("Just wrote char %c at the address : %p\n", 'E', (void*)(test2));
+
+
+	print_small_blocks_used();
+
+
+	Slab* slab = slab_of(test);
+	size_t blockSize = small_class_size[slab->sizeClass];
+	char* blocks = slab_blocks(slab);
+
+	printf("Slab address : %p\n", (void*)slab);
+	printf("Size class of an int : %d (blocks of %d bytes)\n", slab->sizeClass, (int)blockSize);
+	printf("First free block address in the thread cache : %p (%d free blocks cached)\n", (void*)threadCache.firstFreeBlock[slab->sizeClass], threadCache.nbFree[slab->sizeClass]);
+	printf("Number of bytes between the slab and the first free block : %d\n", (int)((char*)threadCache.firstFreeBlock[slab->sizeClass] - (char*)slab));
+	
+
+	myFree(test);
+	printf("Just freed block with address : %p\n", (void*)test);
+
+	printf("First free block address in the thread cache : %p (%d free blocks cached)\n", (void*)threadCache.firstFreeBlock[slab->sizeClass], threadCache.nbFree[slab->sizeClass]);
+
+	printf("States and first words of the first blocks of the slab : \n");
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		printf("State %d and first word %p at the index %d\n", slab_states(slab)[i], (void*)((SmallBlock*)(blocks + i * blockSize))->nextFree, (int)i);
+	}
+
+	myFree(test2);
+	printf("Just freed block with address : %p\n", (void*)test2);
+
+
+}
+
+
+
+#define NB_TEST_THREADS 4
+
+// Each thread allocates blocks of every size class, fills them with its id and checks them before freeing them
+void* test_threads_worker(void* arg)
+{
+	int id = (int)(intptr_t)arg;
+	char* blocks[200];
+	int nbErrors = 0;
+
+	for (int round = 0; round < 100; ++round)
+	{
+		for (int i = 0; i < 200; ++i)
+		{
+			size_t size = (size_t)(i * 5) % SIZE_BLK_SMALL + 1;
+			blocks[i] = myMalloc(size);
+			for (size_t j = 0; j < size; ++j)
+				blocks[i][j] = (char)id;
+		}
+		for (int i = 0; i < 200; ++i)
+		{
+			size_t size = (size_t)(i * 5) % SIZE_BLK_SMALL + 1;
+			for (size_t j = 0; j < size; ++j)
+				nbErrors += blocks[i][j] != (char)id;
+			myFree(blocks[i]);
+		}
+	}
+
+	return (void*)(intptr_t)nbErrors;
+}
+
+void test_threads()
+{
+	pthread_t threads[NB_TEST_THREADS];
+
+	for (int i = 0; i < NB_TEST_THREADS; ++i)
+	{
+		pthread_create(&threads[i], NULL, test_threads_worker, (void*)(intptr_t)(i + 1));
+	}
+	printf("Just started %d threads allocating and freeing small blocks\n", NB_TEST_THREADS);
+
+	for (int i = 0; i < NB_TEST_THREADS; ++i)
+	{
+		void* nbErrors;
+		pthread_join(threads[i], &nbErrors);
+		printf("Thread %d found %d overwritten bytes\n", i + 1, (int)(intptr_t)nbErrors);
+	}
+
+	print_small_blocks_used();
+}
+
+
+
+#define NB_HANDOFF_SLOTS 256
+#define NB_HANDOFF_BLOCKS 20000
+
+// Blocks handed by each producer thread to its consumer thread, NULL when the slot is empty
+char* _Atomic handoffSlots[NB_TEST_THREADS / 2][NB_HANDOFF_SLOTS];
+
+void* test_remote_free_producer(void* arg)
+{
+	int pair = (int)(intptr_t)arg;
+
+	for (int i = 0; i < NB_HANDOFF_BLOCKS; ++i)
+	{
+		char* _Atomic* slot = &handoffSlots[pair][i % NB_HANDOFF_SLOTS];
+		while(*slot != NULL)
+			sched_yield();
+
+		size_t size = (size_t)(i * 7) % SIZE_BLK_SMALL + 1;
+		char* block = myMalloc(size);
+		block[0] = (char)i;
+		block[size - 1] = (char)i;
+		*slot = block;
+	}
+	return NULL;
+}
+
+void* test_remote_free_consumer(void* arg)
+{
+	int pair = (int)(intptr_t)arg;
+	int nbErrors = 0;
+
+	for (int i = 0; i < NB_HANDOFF_BLOCKS; ++i)
+	{
+		char* _Atomic* slot = &handoffSlots[pair][i % NB_HANDOFF_SLOTS];
+		char* block;
+		while((block = *slot) == NULL)
+			sched_yield();
+
+		size_t size = (size_t)(i * 7) % SIZE_BLK_SMALL + 1;
+		nbErrors += block[0] != (char)i || block[size - 1] != (char)i;
+		myFree(block);
+		*slot = NULL;
+	}
+	return (void*)(intptr_t)nbErrors;
+}
+
+void test_remote_free()
+{
+	pthread_t producers[NB_TEST_THREADS / 2];
+	pthread_t consumers[NB_TEST_THREADS / 2];
+
+	for (int i = 0; i < NB_TEST_THREADS / 2; ++i)
+	{
+		pthread_create(&producers[i], NULL, test_remote_free_producer, (void*)(intptr_t)i);
+		pthread_create(&consumers[i], NULL, test_remote_free_consumer, (void*)(intptr_t)i);
+	}
+	printf("Just started %d producer threads handing %d blocks each to a consumer thread that frees them\n", NB_TEST_THREADS / 2, NB_HANDOFF_BLOCKS);
+
+	for (int i = 0; i < NB_TEST_THREADS / 2; ++i)
+	{
+		void* nbErrors;
+		pthread_join(producers[i], NULL);
+		pthread_join(consumers[i], &nbErrors);
+		printf("Consumer %d found %d overwritten blocks\n", i + 1, (int)(intptr_t)nbErrors);
+	}
+
+	print_small_blocks_used();
+}
+
+
+#define NB_TRACED_BLOCKS 3000
+
+void* test_trace_worker(void* arg)
+{
+	(void)arg;
+	for (int i = 0; i < NB_TRACED_BLOCKS; ++i)
+	{
+		char* block = myMalloc((size_t)(i * 13) % 500 + 1);
+		block = myRealloc(block, (size_t)(i * 13) % 500 + 100);
+		myFree(block);
+	}
+	return NULL;
+}
+
+void test_trace()
+{
+	const char* path = "myalloc_test.trace";
+	if(!myTraceStart(path))
+		return;
+
+	pthread_t threads[NB_TEST_THREADS];
+	for (int i = 0; i < NB_TEST_THREADS; ++i)
+	{
+		pthread_create(&threads[i], NULL, test_trace_worker, NULL);
+	}
+	for (int i = 0; i < NB_TEST_THREADS; ++i)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	// The calls myRealloc makes to myMalloc and myFree are not recorded
+	char* block = myCalloc(10, 100);
+	myFree(block);
+	myTraceStop();
+
+	// Not recorded, the trace has stopped
+	myFree(myMalloc(10));
+
+	FILE* traceFile = fopen(path, "rb");
+	TraceHeader header;
+	TraceRecord record;
+	int nbRecords[TRACE_REALLOC + 1] = {0};
+	if(traceFile != NULL && fread(&header, sizeof(header), 1, traceFile) == 1)
+	{
+		while(fread(&record, sizeof(record), 1, traceFile) == 1)
+		{
+			nbRecords[record.sizeOperation & ((1 << TRACE_OPERATION_BITS) - 1)]++;
+		}
+	}
+	if(traceFile != NULL)
+		fclose(traceFile);
+	remove(path);
+
+	printf("Recorded %d threads doing %d malloc, realloc and free each, then one calloc and free\n", NB_TEST_THREADS, NB_TRACED_BLOCKS);
+	printf("The trace holds %d malloc, %d realloc, %d calloc and %d free (expected %d, %d, 1 and %d)\n", nbRecords[TRACE_MALLOC], nbRecords[TRACE_REALLOC],
+		nbRecords[TRACE_CALLOC], nbRecords[TRACE_FREE], NB_TEST_THREADS * NB_TRACED_BLOCKS, NB_TEST_THREADS * NB_TRACED_BLOCKS, NB_TEST_THREADS * NB_TRACED_BLOCKS + 1);
+}
+
+
+
+void* test_stats_worker(void* arg)
+{
+	char** blocks = arg;
+	for (int i = 0; i < 100; ++i)
+	{
+		blocks[i] = myMalloc(100);
+	}
+	return NULL;
+}
+
+void test_stats()
+{
+	MyMallocStats before, during, after;
+	int sizeClass = small_class_lookup[(100 + 7) / 8];
+	myMallocStats(&before);
+
+	// The small blocks are allocated by a thread that exits before they are freed, its counters must be kept
+	char* smallBlocks[100];
+	char* largeBlocks[10];
+	char* mappedBlocks[2];
+	pthread_t thread;
+	pthread_create(&thread, NULL, test_stats_worker, smallBlocks);
+	pthread_join(thread, NULL);
+	for (int i = 0; i < 10; ++i)
+	{
+		largeBlocks[i] = myMalloc(5000);
+	}
+	for (int i = 0; i < 2; ++i)
+	{
+		mappedBlocks[i] = myMalloc(1 << 20);
+	}
+	myMallocStats(&during);
+
+	printf("Allocated 100 small blocks of 100 bytes in another thread, 10 large blocks of 5000 bytes and 2 huge blocks of 1 MiB\n");
+	printf("Small allocations of the class of %d bytes : %d, large allocations : %d, huge allocations : %d\n", (int)during.classes[sizeClass].blockSize,
+		(int)(during.classes[sizeClass].nbAllocs - before.classes[sizeClass].nbAllocs), (int)(during.nbLargeAllocs - before.nbLargeAllocs), (int)(during.nbHugeAllocs - before.nbHugeAllocs));
+	printf("Bytes in use : %d more, peak at least as high : %d\n", (int)(during.bytesInUse - before.bytesInUse), during.peakBytesInUse >= during.bytesInUse);
+
+	// An external monitor reads the same statistics in the shared memory segment
+	int isExported = myStatsExport("myalloc_test_stats", 1000);
+	int fd = shm_open("/myalloc_test_stats", O_RDONLY, 0);
+	MyStatsSegment* segment = fd >= 0 ? mmap(NULL, sizeof(MyStatsSegment), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if(fd >= 0)
+		close(fd);
+	if(isExported && segment != MAP_FAILED)
+	{
+		MyMallocStats exported;
+		uint64_t sequence;
+		do
+		{
+			sequence = atomic_load_explicit(&segment->sequence, memory_order_acquire);
+			memcpy(&exported, &segment->stats, sizeof(MyMallocStats));
+			atomic_thread_fence(memory_order_acquire);
+		}
+		while((sequence & 1) || sequence != atomic_load_explicit(&segment->sequence, memory_order_relaxed));
+		printf("The shared memory segment holds the same bytes in use : %d\n", exported.bytesInUse == during.bytesInUse);
+		munmap(segment, sizeof(MyStatsSegment));
+	}
+	myStatsExportStop();
+
+	for (int i = 0; i < 100; ++i)
+	{
+		myFree(smallBlocks[i]);
+	}
+	for (int i = 0; i < 10; ++i)
+	{
+		myFree(largeBlocks[i]);
+	}
+	for (int i = 0; i < 2; ++i)
+	{
+		myFree(mappedBlocks[i]);
+	}
+	myMallocStats(&after);
+
+	printf("After freeing them, bytes in use back to their first value : %d\n", after.bytesInUse == before.bytesInUse);
+	printf("Free large blocks : %d (%d bytes, largest %d bytes, fragmentation %.2f)\n", (int)after.nbLargeFreeBlocks, (int)after.largeFreeBytes,
+		(int)after.largestFreeBlock, after.fragmentation);
+	printf("System calls : %d mmap, %d munmap, %d mremap, %d mprotect, %d madvise\n", (int)after.nbMmap, (int)after.nbMunmap, (int)after.nbMremap,
+		(int)after.nbMprotect, (int)after.nbMadvise);
+}
+
+
+#define NB_PROFILED_BLOCKS 1000
+
+// Returns the number of sampled blocks in the profile at path, read from its first line
+int test_profile_samples(const char* path)
+{
+	int nbSampled = -1;
+	FILE* profileFile = fopen(path, "r");
+	if(profileFile != NULL)
+	{
+		if(fscanf(profileFile, "heap profile: %d:", &nbSampled) != 1)
+			nbSampled = -1;
+		fclose(profileFile);
+	}
+	return nbSampled;
+}
+
+void test_profile()
+{
+	const char* path = "myalloc_test.heap";
+	char* blocks[NB_PROFILED_BLOCKS];
+
+	mySetSampleRate(4000);
+	for (int i = 0; i < NB_PROFILED_BLOCKS; ++i)
+	{
+		blocks[i] = myMalloc(1000);
+	}
+	myDumpProfile(path);
+	int nbSampled = test_profile_samples(path);
+
+	for (int i = 0; i < NB_PROFILED_BLOCKS; i += 2)
+	{
+		myFree(blocks[i]);
+	}
+	myDumpProfile(path);
+	int nbHalfSampled = test_profile_samples(path);
+
+	for (int i = 1; i < NB_PROFILED_BLOCKS; i += 2)
+	{
+		myFree(blocks[i]);
+	}
+	myDumpProfile(path);
+	int nbLeft = test_profile_samples(path);
+	remove(path);
+	mySetSampleRate(0);
+
+	// A block of 1000 bytes holds a sampled byte with a probability of 1 - exp(-1000 / 4000)
+	printf("Allocated %d blocks of 1000 bytes with a sample every 4000 bytes : %d sampled (about %d expected)\n", NB_PROFILED_BLOCKS, nbSampled, NB_PROFILED_BLOCKS * 221 / 1000);
+	printf("After freeing one block out of two : %d sampled blocks in use, after freeing every block : %d\n", nbHalfSampled, nbLeft);
+}
+
+
+
+#define NB_TIMED_BLOCKS 2000
+
+void test_latency()
+{
+	char* blocks[NB_TIMED_BLOCKS];
+
+	myLatencyEnable(1);
+	MyLatencyStats before;
+	myLatencyStats(&before);
+
+	// Small blocks from the cache and the slabs, large blocks from the bins, huge blocks mapped, and small blocks moved by myRealloc
+	for (int i = 0; i < NB_TIMED_BLOCKS; ++i)
+	{
+		blocks[i] = myMalloc(i % 10 == 0 ? 4000 : 100);
+	}
+	for (int i = 0; i < NB_TIMED_BLOCKS; ++i)
+	{
+		myFree(blocks[i]);
+	}
+	for (int i = 0; i < 4; ++i)
+	{
+		myFree(myMalloc(1 << 20));
+	}
+	for (int i = 0; i < 100; ++i)
+	{
+		myFree(myRealloc(myMalloc(16), 500));
+	}
+
+	MyLatencyStats after;
+	myLatencyStats(&after);
+	myLatencyEnable(0);
+
+	uint64_t counts[LATENCY_NB_CALLS][LATENCY_NB_PATHS];
+	for (int i = 0; i < LATENCY_NB_CALLS; ++i)
+	{
+		for (int j = 0; j < LATENCY_NB_PATHS; ++j)
+		{
+			counts[i][j] = 0;
+			for (int k = 0; k < LATENCY_BUCKETS; ++k)
+			{
+				counts[i][j] += after.counts[i][j][k] - before.counts[i][j][k];
+			}
+		}
+	}
+
+	printf("Allocations : %d measured (%d expected)\n", (int)(counts[LATENCY_ALLOC][LATENCY_CACHE] + counts[LATENCY_ALLOC][LATENCY_SLAB]
+		+ counts[LATENCY_ALLOC][LATENCY_LARGE] + counts[LATENCY_ALLOC][LATENCY_COPY] + counts[LATENCY_ALLOC][LATENCY_SYSTEM]), NB_TIMED_BLOCKS + 104);
+	// The large blocks that grow the heap make a system call, like the 4 huge blocks
+	printf("Large allocations : %d in the bins and %d growing the heap (%d expected)\n", (int)counts[LATENCY_ALLOC][LATENCY_LARGE],
+		(int)counts[LATENCY_ALLOC][LATENCY_SYSTEM] - 4, NB_TIMED_BLOCKS / 10);
+	printf("Frees of large blocks : %d (%d expected), of huge blocks : %d (4 expected)\n", (int)counts[LATENCY_FREE][LATENCY_LARGE],
+		NB_TIMED_BLOCKS / 10, (int)counts[LATENCY_FREE][LATENCY_SYSTEM]);
+	printf("Reallocations copied : %d (100 expected)\n", (int)counts[LATENCY_REALLOC][LATENCY_COPY]);
+
+	printf("\n");
+	fflush(stdout);
+	myLatencyReport(1);
+}
+
+
+
+#define NB_ARENA_OBJECTS 10000
+
+void test_arena()
+{
+	MyMallocStats before;
+	myMallocStats(&before);
+
+	MyArena* arena = myArenaCreate(4096);
+	int* objects[NB_ARENA_OBJECTS];
+	int nbMisaligned = 0;
+	for (int i = 0; i < NB_ARENA_OBJECTS; ++i)
+	{
+		objects[i] = myArenaAlloc(arena, 40);
+		nbMisaligned += ((uintptr_t)objects[i] % BODY_ALIGN) != 0;
+		for (int j = 0; j < 10; ++j)
+		{
+			objects[i][j] = i;
+		}
+	}
+	// An object larger than the chunks gets a chunk of its own
+	char* largeObject = myArenaAlloc(arena, 100000);
+	memset(largeObject, 1, 100000);
+
+	int nbWrong = 0;
+	for (int i = 0; i < NB_ARENA_OBJECTS; ++i)
+	{
+		for (int j = 0; j < 10; ++j)
+		{
+			nbWrong += objects[i][j] != i;
+		}
+	}
+	printf("Allocated %d objects of 40 bytes from an arena : %d misaligned, %d wrong values\n", NB_ARENA_OBJECTS, nbMisaligned, nbWrong);
+
+	MyMallocStats filled;
+	myMallocStats(&filled);
+
+	// After a reset the same chunks are used again
+	int* firstObject = objects[0];
+	myArenaReset(arena);
+	for (int i = 0; i < NB_ARENA_OBJECTS; ++i)
+	{
+		objects[i] = myArenaAlloc(arena, 40);
+	}
+	MyMallocStats reused;
+	myMallocStats(&reused);
+	printf("After a reset : first object %s, %d chunks taken from the allocator (0 expected)\n", objects[0] == firstObject ? "reused" : "not reused",
+		(int)(reused.nbLargeAllocs - filled.nbLargeAllocs + reused.nbHugeAllocs - filled.nbHugeAllocs));
+
+	myArenaDestroy(arena);
+	MyMallocStats after;
+	myMallocStats(&after);
+	printf("Chunks taken from the allocator : %d, given back : %d\n", (int)(filled.nbLargeAllocs - before.nbLargeAllocs + filled.nbHugeAllocs - before.nbHugeAllocs),
+		(int)(after.nbLargeFrees - before.nbLargeFrees + after.nbHugeFrees - before.nbHugeFrees));
+}
+
+
+
+#define NB_BATCH_BLOCKS 500
+#define NB_BATCH_ROUNDS 2000
+
+void test_batch()
+{
+	void* blocks[NB_BATCH_BLOCKS];
+	MyMallocStats before;
+	myMallocStats(&before);
+
+	// Small blocks, filled with their index
+	size_t nbSmall = myMallocBatch(40, NB_BATCH_BLOCKS, blocks);
+	int nbWrong = 0;
+	for (size_t i = 0; i < nbSmall; ++i)
+	{
+		unsigned char* state = small_body_state(blocks[i]);
+		nbWrong += state == NULL || !(*state & BLOCK_IN_USE) || ((uintptr_t)blocks[i] % BODY_ALIGN) != 0;
+		memset(blocks[i], (int)i, 40);
+	}
+	for (size_t i = 0; i < nbSmall; ++i)
+	{
+		nbWrong += ((unsigned char*)blocks[i])[39] != (unsigned char)i;
+	}
+	myFreeBatch(blocks, nbSmall);
+	printf("Allocated %d small blocks at once : %d wrong\n", (int)nbSmall, nbWrong);
+
+	// The blocks refilled and not taken stay in the cache of the thread, within its limit
+	size_t nbFew = myMallocBatch(40, 5, blocks);
+	printf("Allocated %d small blocks at once : %d blocks left in the cache of the thread (at most %d)\n", (int)nbFew, threadCache.nbFree[small_class_lookup[(40 + 7) / 8]], CACHE_MAX);
+	myFreeBatch(blocks, nbFew);
+
+	MyMallocStats beforeEmpty;
+	myMallocStats(&beforeEmpty);
+	size_t nbEmpty = myMallocBatch(2000, 0, blocks);
+	MyMallocStats afterEmpty;
+	myMallocStats(&afterEmpty);
+	printf("Allocated %d large blocks at once : %d bytes more in use\n", (int)nbEmpty, (int)(afterEmpty.bytesInUse - beforeEmpty.bytesInUse));
+
+	// Large blocks, carved one after the other from one block
+	size_t nbLarge = myMallocBatch(3000, 50, blocks);
+	int nbApart = 0;
+	for (size_t i = 0; i < nbLarge; ++i)
+	{
+		memset(blocks[i], (int)i, 3000);
+		if(i > 0 && (char*)blocks[i] - (char*)blocks[i - 1] != (ptrdiff_t)large_block_size(3000))
+			nbApart++;
+	}
+	nbWrong = 0;
+	for (size_t i = 0; i < nbLarge; ++i)
+	{
+		nbWrong += ((unsigned char*)blocks[i])[2999] != (unsigned char)i || myTryExpand(blocks[i], 0, 0) < 3000;
+	}
+	printf("Allocated %d large blocks at once : %d not consecutive, %d wrong\n", (int)nbLarge, nbApart, nbWrong);
+
+	// Blocks of every kind freed together
+	blocks[nbLarge] = myMalloc(100);
+	blocks[nbLarge + 1] = myMalloc(1 << 20);
+	myFreeBatch(blocks, nbLarge + 2);
+
+	MyMallocStats after;
+	myMallocStats(&after);
+	int nbLeft = 0;
+	for (int i = 0; i < NB_SMALL_CLASSES; ++i)
+	{
+		nbLeft += (int)((after.classes[i].nbAllocs - before.classes[i].nbAllocs) - (after.classes[i].nbFrees - before.classes[i].nbFrees));
+	}
+	nbLeft += (int)((after.nbLargeAllocs - before.nbLargeAllocs) - (after.nbLargeFrees - before.nbLargeFrees));
+	nbLeft += (int)((after.nbHugeAllocs - before.nbHugeAllocs) - (after.nbHugeFrees - before.nbHugeFrees));
+	printf("Blocks not freed : %d\n", nbLeft);
+
+	// Rounds of 64 blocks, allocated and freed one by one then at once
+	uint64_t startTime = current_time_ns();
+	for (int i = 0; i < NB_BATCH_ROUNDS; ++i)
+	{
+		for (int j = 0; j < 64; ++j)
+		{
+			blocks[j] = myMalloc(64);
+		}
+		for (int j = 0; j < 64; ++j)
+		{
+			myFree(blocks[j]);
+		}
+	}
+	uint64_t singleTime = current_time_ns() - startTime;
+	startTime = current_time_ns();
+	for (int i = 0; i < NB_BATCH_ROUNDS; ++i)
+	{
+		myMallocBatch(64, 64, blocks);
+		myFreeBatch(blocks, 64);
+	}
+	uint64_t batchTime = current_time_ns() - startTime;
+	printf("64 blocks allocated and freed : %.1f ns per block one by one, %.1f ns per block at once\n",
+		(double)singleTime / (NB_BATCH_ROUNDS * 64), (double)batchTime / (NB_BATCH_ROUNDS * 64));
+}
+
+
+
+void test_sizes()
+{
+	// Sizes of a small, a large and a huge block, rounded up to the size of their body
+	size_t sizes[3] = {100, 5000, 300000};
+	for (int i = 0; i < 3; ++i)
+	{
+		size_t goodSize = myGoodSize(sizes[i]);
+		char* ptr = myMalloc(sizes[i]);
+		char* goodPtr = myMalloc(goodSize);
+		printf("Size %d : good size %d, usable size %d and %d with the good size\n", (int)sizes[i], (int)goodSize, (int)myUsableSize(ptr), (int)myUsableSize(goodPtr));
+		memset(ptr, 1, myUsableSize(ptr));
+		myFreeSized(ptr, sizes[i]);
+		myFreeSized(goodPtr, goodSize);
+	}
+
+	// The same block is given back after a sized free, which also finds a double free
+	char* ptr = myMalloc(40);
+	myFreeSized(ptr, 40);
+	char* samePtr = myMalloc(40);
+	printf("Block given again after a sized free : %s\n", samePtr == ptr ? "yes" : "no");
+	myFreeSized(samePtr, 40);
+	myFreeSized(samePtr, 40);
+
+	// A block kept by myRealloc when it shrinks is in a larger class than its size
+	ptr = myRealloc(myMalloc(500), 20);
+	myFreeSized(ptr, 20);
+	samePtr = myMalloc(500);
+	printf("Shrunk block freed in its own class : %s\n", samePtr == ptr ? "yes" : "no");
+	printf("Usable size of an address inside the block : %d\n", (int)myUsableSize(samePtr + 16));
+	myFree(samePtr);
+}
+
+
+void test_page_map()
+{
+	char* largePtr = myMalloc(5000);
+	char* hugePtr = myMalloc(300000);
+	int local = 0;
+
+	// Addresses inside a block, next to it and out of the allocator are rejected without reading any header
+	myFree(largePtr + 16);
+	myFree(largePtr + 1);
+	myFree(hugePtr + 4096);
+	myFree(hugePtr + 300000);
+	myFree(&local);
+	printf("Blocks still in use after the wrong frees : %s\n", myUsableSize(largePtr) > 0 && myUsableSize(hugePtr) > 0 ? "yes" : "no");
+	printf("Usable size of addresses inside the blocks : %d and %d (0 expected)\n", (int)myUsableSize(largePtr + 16), (int)myUsableSize(hugePtr + 4096));
+
+	// A huge block moved by myRealloc is found at its new place only
+	char* movedPtr = myRealloc(hugePtr, 4000000);
+	printf("Huge block moved : %s, old address %s\n", movedPtr != hugePtr ? "yes" : "no", movedPtr == hugePtr || myUsableSize(hugePtr) == 0 ? "rejected" : "still found");
+	printf("Huge block found from its last page : %s\n", is_huge_address(movedPtr + 4000000 - 1) ? "yes" : "no");
+
+	// A block freed twice is caught the second time
+	myFree(largePtr);
+	myFree(largePtr);
+	myFree(movedPtr);
+	printf("Huge block found after its free : %s\n", is_huge_address(movedPtr) ? "yes" : "no");
+}
+
+
+#define NB_PERCPU_THREADS 32
+#define NB_PERCPU_BLOCKS 200
+#define NB_PERCPU_ROUNDS 200
+
+pthread_barrier_t percpuBarrier;
+
+// Allocates and frees blocks of every class, checking that no block is given twice, then stays idle until the cached blocks are counted
+void* test_percpu_worker(void* arg)
+{
+	int* nbWrong = arg;
+	void* blocks[NB_PERCPU_BLOCKS];
+	for(int round = 0; round < NB_PERCPU_ROUNDS; ++round)
+	{
+		for(int i = 0; i < NB_PERCPU_BLOCKS; ++i)
+		{
+			size_t size = 8 + (size_t)((i * 37 + round) % (SIZE_BLK_SMALL - 8));
+			blocks[i] = myMalloc(size);
+			memset(blocks[i], i & 0xff, size);
+		}
+		for(int i = 0; i < NB_PERCPU_BLOCKS; ++i)
+		{
+			size_t size = 8 + (size_t)((i * 37 + round) % (SIZE_BLK_SMALL - 8));
+			if(((unsigned char*)blocks[i])[0] != (i & 0xff) || ((unsigned char*)blocks[i])[size - 1] != (i & 0xff))
+				(*nbWrong)++;
+			myFree(blocks[i]);
+		}
+	}
+
+	pthread_barrier_wait(&percpuBarrier);
+	pthread_barrier_wait(&percpuBarrier);
+	return NULL;
+}
+
+// Returns the number of free blocks kept by the caches of the threads or of the CPUs while NB_PERCPU_THREADS threads are idle
+uint64_t test_percpu_cached(int* nbWrong)
+{
+	pthread_t threads[NB_PERCPU_THREADS];
+	int wrongs[NB_PERCPU_THREADS] = {0};
+	pthread_barrier_init(&percpuBarrier, NULL, NB_PERCPU_THREADS + 1);
+	for(int i = 0; i < NB_PERCPU_THREADS; ++i)
+	{
+		pthread_create(&threads[i], NULL, test_percpu_worker, &wrongs[i]);
+	}
+
+	pthread_barrier_wait(&percpuBarrier);
+	MyMallocStats stats;
+	myMallocStats(&stats);
+	uint64_t nbCached = 0;
+	for(int i = 0; i < NB_SMALL_CLASSES; ++i)
+	{
+		nbCached += stats.classes[i].nbCached;
+	}
+	pthread_barrier_wait(&percpuBarrier);
+
+	for(int i = 0; i < NB_PERCPU_THREADS; ++i)
+	{
+		pthread_join(threads[i], NULL);
+		*nbWrong += wrongs[i];
+	}
+	pthread_barrier_destroy(&percpuBarrier);
+	return nbCached;
+}
+
+void test_percpu()
+{
+	int nbWrong = 0;
+	uint64_t threadCached = test_percpu_cached(&nbWrong);
+
+	int mode = myPerCpuEnable(1);
+	printf("Caches of the CPUs found with %s\n", mode == PERCPU_RSEQ ? "restartable sequences" : mode == PERCPU_GETCPU ? "sched_getcpu" : "nothing");
+	uint64_t cpuCached = test_percpu_cached(&nbWrong);
+
+	// Blocks freed by other threads and by myFreeBatch go to the cache of the CPU too
+	void* blocks[NB_PERCPU_BLOCKS];
+	size_t nbBlocks = myMallocBatch(48, NB_PERCPU_BLOCKS, blocks);
+	myFreeBatch(blocks, nbBlocks);
+	myPerCpuEnable(0);
+
+	printf("%d threads : %d wrong blocks\n", NB_PERCPU_THREADS, nbWrong);
+	printf("Blocks cached while the threads are idle : %d with the caches of the threads, %d with the caches of the CPUs\n", (int)threadCached, (int)cpuCached);
+	printf("At most %d blocks cached per class and CPU : %s\n", CACHE_MAX, cpuCached <= (uint64_t)(NB_SMALL_CLASSES * CACHE_MAX * sysconf(_SC_NPROCESSORS_CONF)) ? "yes" : "no");
+}
@@ -1,47 +1,111 @@
-#include "myalloc.h"
-
-int main()
-{
-
-	printf("\n-------------------\n Small blocks general test : \n-------------------\n\n");
-
-	test_general();
-
-	printf("\n-------------------\n Small blocks free test 1 : \n-------------------\n\n");
-
-	test_free1();
-
-	printf("\n-------------------\n Small blocks free test 2 : \n-------------------\n\n");
-
-	test_free2();
-
-	printf("\n-------------------\n Small blocks malloc test : \n-------------------\n\n");
-
-	test_malloc1();
-
-	printf("\n-------------------\n Small blocks  realloc test : \n-------------------\n\n");
-
-	test_realloc();
-
-	printf("\n-------------------\n Small blocks header test : \n-------------------\n\n");
-
-	test_header();
-
-	printf("\n-------------------\n Large blocks test 1: \n-------------------\n\n");
-
-	test_large_block1();
-
-	printf("\n-------------------\n Large blocks test 2 : \n-------------------\n\n");
-
-	test_large_block2();
-
-	printf("\n-------------------\n Speed test : \n-------------------\n\n");
-
-	speed_test(100000); // one hundred million tests
-
-	// printf("poop");
-
-	// while(1){};
-
-	return 0;
+#include "myalloc.h"
+
+int main()
+{
+
+	printf("\n-------------------\n Small blocks general test : \n-------------------\n\n");
+
+	test_general();
+
+	printf("\n-------------------\n Small blocks free test 1 : \n-------------------\n\n");
+
+	test_free1();
+
+	printf("\n-------------------\n Small blocks free test 2 : \n-------------------\n\n");
+
+	test_free2();
+
+	printf("\n-------------------\n Small blocks malloc test : \n-------------------\n\n");
+
+	test_malloc1();
+
+	printf("\n-------------------\n Small blocks  realloc test : \n-------------------\n\n");
+
+	test_realloc();
+
+	printf("\n-------------------\n Small blocks header test : \n-------------------\n\n");
+
+	test_header();
+
+	printf("\n-------------------\n Large blocks test 1: \n-------------------\n\n");
+
+	test_large_block1();
+
+	printf("\n-------------------\n Large blocks test 2 : \n-------------------\n\n");
+
+	test_large_block2();
+
+	printf("\n-------------------\n Large blocks test 3 : \n-------------------\n\n");
+
+	test_large_block3();
+
+	printf("\n-------------------\n Expand test : \n-------------------\n\n");
+
+	test_expand();
+
+	printf("\n-------------------\n Aligned alloc test : \n-------------------\n\n");
+
+	test_aligned();
+
+	printf("\n-------------------\n Calloc test : \n-------------------\n\n");
+
+	test_calloc();
+
+	printf("\n-------------------\n Huge blocks test : \n-------------------\n\n");
+
+	test_huge_block();
+
+	printf("\n-------------------\n Trim test : \n-------------------\n\n");
+
+	test_trim();
+
+	printf("\n-------------------\n Threads test : \n-------------------\n\n");
+
+	test_threads();
+
+	printf("\n-------------------\n Remote free test : \n-------------------\n\n");
+
+	test_remote_free();
+
+	printf("\n-------------------\n Trace test : \n-------------------\n\n");
+
+	test_trace();
+
+	printf("\n-------------------\n Statistics test : \n-------------------\n\n");
+
+	test_stats();
+
+	printf("\n-------------------\n Profile test : \n-------------------\n\n");
+
+	test_profile();
+
+	printf("\n-------------------\n Latency test : \n-------------------\n\n");
+
+	test_latency();
+
+	printf("\n-------------------\n Arena test : \n-------------------\n\n");
+
+	test_arena();
+
+	printf("\n-------------------\n Batch test : \n-------------------\n\n");
+
+	test_batch();
+
+	printf("\n-------------------\n Size test : \n-------------------\n\n");
+
+	test_sizes();
+
+	printf("\n-------------------\n Page map test : \n-------------------\n\n");
+
+	test_page_map();
+
+	printf("\n-------------------\n Per-CPU test : \n-------------------\n\n");
+
+	test_percpu();
+
+	// printf("poop");
+
+	// while(1){};
+
+	return 0;
 }
\ No newline at end of file